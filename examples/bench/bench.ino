@@ -0,0 +1,237 @@
+// bench.ino - A benchmark for cmd; replays recorded sessions and reports throughput and latency
+#include "cmd.h"
+
+
+// The sessions ===========================================================================
+
+
+// Each session is a recorded sequence of lines as a host would send them.
+// They are replayed BENCH_REPEAT times, by feeding them char by char to cmd_add(),
+// or (bulk) line by line to cmd_addbuf().
+#define BENCH_REPEAT 10
+
+
+// A streaming session: hex bursts, like the streaming example receives them
+const char bench_stream[] PROGMEM =
+  "sink *\n"
+  "0000 0001 0002 0003 0004 0005 0006 0007 0008 0009 000A 000B 000C 000D 000E 000F\n"
+  "1F2E 3D4C 5B6A 7988 97A6 B5C4 D3E2 F100 0F1E 2D3C 4B5A 6978 8796 A5B4 C3D2 E1F0\n"
+  "FFFF 7FFF 3FFF 1FFF 0FFF 07FF 03FF 01FF 00FF 007F 003F 001F 000F 0007 0003 0001\n"
+  "12 34 56 78 9A BC DE F0 12 34 56 78 9A BC DE F0 12 34 56 78 9A BC DE F0 12 34\n"
+  "ABCD ABCD ABCD ABCD ABCD ABCD ABCD ABCD // with a trailing comment\n"
+  "*\n"
+;
+
+
+// A help session: long output from PROGMEM
+const char bench_help[] PROGMEM =
+  "help\n"
+  "help echo\n"
+  "help help\n"
+  "h s\n"
+;
+
+
+// A command session: short commands, with abbreviations and the @ prefix
+const char bench_cmds[] PROGMEM =
+  "echo line Hello, World!\n"
+  "@echo faults step\n"
+  "@echo faults\n"
+  "sink 1 2 3\n"
+  "s 4 5 6\n"
+  "unknown command\n"
+  "\n"
+;
+
+
+// The sink command =======================================================================
+
+
+// The sink only counts the values it receives (in command or in streaming mode)
+uint32_t cmdsink_count=0;
+
+
+void cmdsink_streamfunc( int argc, char * argv[] ) {
+  for( int i=0; i<argc; i++ ) {
+    uint16_t val;
+    if( strcmp(argv[i],"*")==0 ) {
+      if( cmd_get_streamfunc()==0 ) cmd_set_streamfunc(cmdsink_streamfunc); else cmd_set_streamfunc(0);
+    } else if( cmd_parse_hex(argv[i],&val) ) {
+      cmdsink_count+= 1;
+    }
+  }
+  #if CMD_STREAMPROMPT
+    cmd_set_streamprompt("sink>> ");
+  #endif
+}
+
+
+void cmdsink_main(int argc, char * argv[]) {
+  cmdsink_streamfunc(argc-1, argv+1);
+}
+
+
+const char cmdsink_longhelp[] PROGMEM =
+  "SYNTAX: sink (*|<hexnum>)...\n"
+  "- counts the hex numbers (a * toggles streaming mode)\n"
+;
+
+
+void cmdsink_register(void) {
+  cmd_register(cmdsink_main, PSTR("sink"), PSTR("counts hex numbers (benchmark helper)"), cmdsink_longhelp);
+}
+
+
+// The boot script ========================================================================
+
+
+// A boot self-test: as plain text (replayed with cmd_addstr_P) and as compiled script (replayed with cmd_script_run)
+const char bench_boot[] PROGMEM =
+  "@echo faults\n"
+  "echo line selftest start\n"
+  "sink 0001 0002 0003 0004 0005 0006 0007 0008\n"
+  "sink 1F2E 3D4C 5B6A 7988 97A6 B5C4 D3E2 F100\n"
+  "sink FFFF 7FFF 3FFF 1FFF 0FFF 07FF 03FF 01FF\n"
+  "echo line selftest done\n"
+;
+#define BENCH_BOOT(X) \
+  X( cmdecho_main, "@echo faults" ) \
+  X( cmdecho_main, "echo line selftest start" ) \
+  X( cmdsink_main, "sink 0001 0002 0003 0004 0005 0006 0007 0008" ) \
+  X( cmdsink_main, "sink 1F2E 3D4C 5B6A 7988 97A6 B5C4 D3E2 F100" ) \
+  X( cmdsink_main, "sink FFFF 7FFF 3FFF 1FFF 0FFF 07FF 03FF 01FF" ) \
+  X( cmdecho_main, "echo line selftest done" )
+CMD_SCRIPT(bench_bootscript, BENCH_BOOT)
+
+
+// Replays the boot script BENCH_REPEAT times, as text and compiled, and prints both durations
+void bench_boot_run( void ) {
+  cmd_get_outstats(true);
+  uint32_t t= micros();
+  for( int rep=0; rep<BENCH_REPEAT; rep++ ) cmd_addstr_P(bench_boot);
+  uint32_t text= micros()-t;
+  uint32_t textout= cmd_get_outstats(true).bytes;
+  t= micros();
+  cmd_script_run(&bench_bootscript, BENCH_REPEAT, false);
+  uint32_t compiled= micros()-t;
+  uint32_t compiledout= cmd_get_outstats(true).bytes;
+  cmd_outflush();
+  Serial.flush();
+  Serial.print(F("\nbench: boot: text "));  Serial.print(text); Serial.print(F(" us (")); Serial.print(textout); 
+  Serial.print(F(" bytes out), compiled ")); Serial.print(compiled); Serial.print(F(" us (")); Serial.print(compiledout); Serial.print(F(" bytes out)\n"));
+}
+
+
+// The benchmark ==========================================================================
+
+
+// Per-line execution latencies (only the first BENCH_SAMPLES lines of a session are sampled)
+#define BENCH_SAMPLES 64
+uint32_t bench_lat[BENCH_SAMPLES];
+int      bench_latn;
+
+
+// Replays `session` BENCH_REPEAT times and prints throughput, output bytes and latency percentiles.
+// With `bulk` lines are fed with cmd_addbuf() and the latency is that of the whole line.
+void bench_run( const __FlashStringHelper * name, /*PROGMEM*/const char * session, bool bulk ) {
+  uint32_t chars= 0;
+  bench_latn= 0;
+  cmd_get_outstats(true);
+  uint32_t start= micros();
+  for( int rep=0; rep<BENCH_REPEAT; rep++ ) {
+    const char * s= session;
+    char ch;
+    if( bulk ) {
+      while( pgm_read_byte(s)!='\0' ) {
+        // Copy one line (including its newline) to RAM
+        char line[CMD_BUFSIZE];
+        size_t len= 0;
+        do { ch= pgm_read_byte(s++); line[len++]= ch; } while( ch!='\n' && len<sizeof line );
+        uint32_t t= micros();
+        cmd_addbuf(line, len);
+        t= micros()-t;
+        if( bench_latn<BENCH_SAMPLES ) bench_lat[bench_latn++]= t;
+        chars+= len;
+      }
+    } else {
+      while( '\0' != (ch=pgm_read_byte(s++)) ) {
+        if( ch=='\n' ) {
+          // The newline is where the command executes: time it
+          uint32_t t= micros();
+          cmd_add(ch);
+          t= micros()-t;
+          if( bench_latn<BENCH_SAMPLES ) bench_lat[bench_latn++]= t;
+        } else {
+          cmd_add(ch);
+        }
+        chars++;
+      }
+    }
+  }
+  uint32_t duration= micros()-start;
+  cmd_outstats_t stats= cmd_get_outstats(true);
+  cmd_outflush();
+  Serial.flush();
+
+  // Sort the latencies (insertion sort, there are only a few)
+  for( int i=1; i<bench_latn; i++ ) {
+    uint32_t v= bench_lat[i];
+    int j= i;
+    while( j>0 && bench_lat[j-1]>v ) { bench_lat[j]= bench_lat[j-1]; j--; }
+    bench_lat[j]= v;
+  }
+
+  Serial.print(F("\nbench: ")); Serial.print(name); Serial.print(bulk?F(" (bulk): "):F(": "));
+  Serial.print(chars); Serial.print(F(" chars in ")); Serial.print(duration); Serial.print(F(" us = "));
+  Serial.print( duration==0 ? 0 : (uint32_t)((uint64_t)chars*1000000/duration) ); Serial.print(F(" chars/s, "));
+  Serial.print(stats.bytes); Serial.print(F(" bytes out ("));  Serial.print(stats.stalls); Serial.print(F(" stalls)\n"));
+  if( bench_latn>0 ) {
+    Serial.print(F("bench: ")); Serial.print(name); Serial.print(bulk?F(" (bulk): "):F(": ")); 
+    Serial.print(bulk?F("line us p50/p90/p99/max "):F("exec us p50/p90/p99/max "));
+    Serial.print(bench_lat[bench_latn*50/100]); Serial.print('/');
+    Serial.print(bench_lat[bench_latn*90/100]); Serial.print('/');
+    Serial.print(bench_lat[bench_latn*99/100]); Serial.print('/');
+    Serial.print(bench_lat[bench_latn-1]);
+    Serial.print(F(" (")); Serial.print(bench_latn); Serial.print(F(" lines)\n"));
+  }
+}
+
+
+// The main program =======================================================================
+
+
+void setup() {
+  // Use a high baud rate, the output of the replayed sessions is part of what is measured
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.bench") );
+
+  cmd_init();
+  cmdecho_register();  // Use the built-in echo command
+  cmdhelp_register();  // Use the built-in help command
+  cmdsink_register();  // Register the sink for the streaming session
+#if CMD_PROF
+  cmdprof_register();  // Use the built-in prof command (note: profiling adds to the measured times)
+#endif
+  Serial.println( );
+
+  bench_run( F("stream"), bench_stream, false );
+  bench_run( F("stream"), bench_stream, true );
+  bench_run( F("help"), bench_help, false );
+  bench_run( F("cmds"), bench_cmds, false );
+  bench_boot_run();
+  Serial.print( F("\nbench: sink received ") ); Serial.print(cmdsink_count); Serial.print( F(" values\n") );
+#if CMD_PROF
+  Serial.print( F("\nbench: profile of all sessions\n") );
+  cmd_addstr("prof\n");
+  cmd_outflush();
+#endif
+
+  Serial.println( );
+  Serial.println( F("Type 'help' for help") );
+  cmd_prompt();
+}
+
+
+void loop() {
+  cmd_pollserial();
+}
@@ -10,37 +10,44 @@ int cmdstat_count=0;
 int cmdstat_sum=0;
 
 
-// The statistics command handler
-void cmdstat_main(int argc, char * argv[]) {
-  // Note cmd_isprefix needs a PROGMEM string. PSTR stores the string in PROGMEM.
-  if( argc==2 && cmd_isprefix(PSTR("reset"),argv[1]) ) { 
-    cmdstat_count= 0;
-    cmdstat_sum= 0;
-    Serial.println(F("stat: reset"));
-    return;
-  }
-  if( argc==1 || (argc==2 && cmd_isprefix(PSTR("show"),argv[1])) ) {
-    Serial.print(F("stat: ")); 
-    Serial.print(cmdstat_sum); Serial.print(F("/")); Serial.print(cmdstat_count); 
-    if( cmdstat_count>0 ) { Serial.print(F("=")); Serial.print((float)cmdstat_sum/cmdstat_count); }
-    Serial.println();
-    return;
-  }
-  for( int i=1; i<argc; i++ ) {
-    uint16_t val;
-    bool ok= cmd_parse_hex(argv[i],&val) ;
-    if( !ok ) {
-      Serial.print(F("Error: sum: value must be hex '"));
-      Serial.print(argv[i]);
-      Serial.println("'");
-      return;
-    }
-    cmdstat_sum+= val;
+// The handlers for the subcommands (vals as declared in STAT_SUBS)
+void cmdstat_show(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)n; (void)vals;
+  cmd_out.print(F("stat: ")); 
+  cmd_out.print(cmdstat_sum); cmd_out.print(F("/")); cmd_out.print(cmdstat_count); 
+  if( cmdstat_count>0 ) { cmd_out.print(F("=")); cmd_out.print((float)cmdstat_sum/cmdstat_count); }
+  cmd_out.println();
+}
+void cmdstat_reset(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)n; (void)vals;
+  cmdstat_count= 0;
+  cmdstat_sum= 0;
+  cmd_out.println(F("stat: reset"));
+}
+void cmdstat_add(char * argv[], int n, const cmd_val_t * vals) {
+  if( n==0 ) { cmdstat_show(argv,n,vals); return; } // Without arguments, stat shows
+  for( int i=0; i<n; i++ ) {
+    cmdstat_sum+= vals[i].hex16;
     cmdstat_count+= 1;
   }
 }
 
 
+// The subcommands: the default (no name) takes zero or more hex numbers. 
+// Note the names must be in alphabetical order (the compiler checks that).
+#define STAT_SUBS(X) \
+  X(      , "[h*", "", cmdstat_add   ) \
+  X( reset, "",    "", cmdstat_reset ) \
+  X( show,  "",    "", cmdstat_show  )
+CMD_SUBS(cmdstat_subs, STAT_SUBS)
+
+
+// The statistics command handler: cmd_dispatch finds the subcommand, parses the arguments, and reports errors
+void cmdstat_main(int argc, char * argv[]) {
+  cmd_dispatch(argc, argv, cmdstat_subs, CMD_TABLE_COUNT(cmdstat_subs));
+}
+
+
 // Note cmd_register needs all strigs to be PROGMEM strings. For longhelp we do that manually
 const char cmdstat_longhelp[] PROGMEM = 
   "SYNTAX: stat reset\n"
@@ -69,6 +76,12 @@ void setup() {
   cmdecho_register();  // Use the built-in echo command
   cmdhelp_register();  // Use the built-in help command
   cmdstat_register();  // Register our own stat command
+#if CMD_PROF
+  cmdprof_register();  // Use the built-in prof command (not on AVR)
+#endif
+#if CMD_TRACE
+  cmdtrace_register(); // Use the built-in trace command (not on AVR)
+#endif
   Serial.println( );
 
   Serial.println( F("Type 'help' for help") );
@@ -5,9 +5,10 @@
 // The stat command =======================================================================
 
 
-// The statistics counters
-int cmdstat_count=0;
-int cmdstat_sum=0;
+// The statistics (count, mean, variance, min/max, histogram and percentiles), updated per value
+cmd_stats_t cmdstat_stats;
+static const char cmdstat_name[] PROGMEM = "stat";
+
 
 void cmdstat_streamfunc( int argc, char * argv[] ) {
   for( int i=0; i<argc; i++ ) {
@@ -18,39 +19,62 @@ void cmdstat_streamfunc( int argc, char * argv[] ) {
     } else {
       bool ok= cmd_parse_hex(argv[i],&val) ;
       if( !ok ) {
-        Serial.print(F("Error: value must be hex '"));
-        Serial.print(argv[i]);
-        Serial.println("'");
+        cmd_out.print(F("Error: value must be hex '"));
+        cmd_out.print(argv[i]);
+        cmd_out.println("'");
         return;
       }
-      cmdstat_sum+= val;
-      cmdstat_count+= 1;
+      cmd_stats_add(&cmdstat_stats, val);
     }
   }
   // Set the streaming prompt (will only be shown in streaming mode)
-  cmd_set_streampromptf("%03d>> ",cmdstat_count); 
+  #if CMD_STREAMPROMPT
+    cmd_set_streampromptf("%03d>> ",(int)cmdstat_stats.count); 
+  #endif
+}
+
+
+// Binary streaming: the payload of each frame is a sequence of 16 bit values, low byte first
+void cmdstat_binfunc( const uint8_t * data, int len ) {
+  for( int i=0; i+1<len; i+=2 ) {
+    cmd_stats_add(&cmdstat_stats, data[i] | data[i+1]<<8);
+  }
+}
+
+
+// The handlers for the subcommands (vals as declared in STAT_SUBS)
+void cmdstat_show(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)vals;
+  cmd_stats_print(&cmdstat_stats, cmdstat_name, n==1);
+}
+void cmdstat_values(char * argv[], int n, const cmd_val_t * vals) {
+  if( n==0 ) { cmdstat_show(argv, n, vals); return; } // Without arguments, stat shows
+  // The values would be parsed exactly as the streaming handler does; so simply call that one (skipping 'stat')
+  cmdstat_streamfunc(n, argv+1);
 }
+void cmdstat_reset(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)n; (void)vals;
+  cmd_stats_reset(&cmdstat_stats);
+  cmd_out.println(F("stat: reset"));
+}
+
+
+// The subcommands: the default (no name) takes the values (and *)
+#define STAT_SUBS(X) \
+  X(      , "[s*", "",     cmdstat_values ) \
+  X( reset, "",    "",     cmdstat_reset  ) \
+  X( show,  "[e",  "hist", cmdstat_show   )
+CMD_SUBS(cmdstat_subs, STAT_SUBS)
 
 
 // The statistics command handler
 void cmdstat_main(int argc, char * argv[]) {
-  if( argc==2 && cmd_isprefix(PSTR("reset"),argv[1]) ) {
-    cmdstat_count= 0;
-    cmdstat_sum= 0;
-    Serial.println(F("stat: reset"));
-    return;
-  }
-  if( argc==1 || (argc==2 && cmd_isprefix(PSTR("show"),argv[1])) ) {
-    Serial.print(F("stat: ")); 
-    Serial.print(cmdstat_sum); Serial.print(F("/")); Serial.print(cmdstat_count); 
-    if( cmdstat_count>0 ) { Serial.print(F("=")); Serial.print((float)cmdstat_sum/cmdstat_count); }
-    Serial.println();
+  if( argc==2 && strcmp(argv[1],"#")==0 ) {
+    cmd_out.println(F("stat: binary (send frames, empty frame to stop)"));
+    cmd_set_binfunc(cmdstat_binfunc);
     return;
   }
-  // The rest of the function would do core processing: reading values and add them 
-  // to the statistics counters. But that same code would be in the streaming handler.
-  // So here we can simply call that one, except that we need to shift the argument.
-  cmdstat_streamfunc(argc-1, argv+1);
+  cmd_dispatch(argc, argv, cmdstat_subs, CMD_TABLE_COUNT(cmdstat_subs));
 }
 
 
@@ -58,17 +82,21 @@ void cmdstat_main(int argc, char * argv[]) {
 const char cmdstat_longhelp[] PROGMEM = 
   "SYNTAX: stat reset\n"
   "- resets the statistic counters\n"
-  "SYNTAX: stat show\n"
-  "- shows the statistic counters\n"
+  "SYNTAX: stat show [hist]\n"
+  "- shows the statistics: count, min, max, mean, stddev and percentile estimates\n"
+  "- with hist also the histogram\n"
   "SYNTAX: stat (*|<hexnum>)...\n"
-  "- updates the statistic counters (sum and count)\n"
+  "- adds the values to the statistics\n"
   "- a * toggle streaming mode\n"
+  "SYNTAX: stat #\n"
+  "- enters binary streaming mode (COBS frames with CRC, see cmd.h)\n"
+  "- each frame holds 16 bit values (low byte first), an empty frame stops\n"
 ;
 
 
 // Note cmd_register needs all strings to be PROGMEM strings. For the short string we do that inline with PSTR.
 void cmdstat_register(void) {
-  cmd_register(cmdstat_main, PSTR("stat"), PSTR("compute count, sum and average of hex numbers"), cmdstat_longhelp);
+  cmd_register(cmdstat_main, PSTR("stat"), PSTR("statistics of hex numbers"), cmdstat_longhelp);
 }
 
 
@@ -83,6 +111,7 @@ void setup() {
   cmdecho_register();  // Use the built-in echo command
   cmdhelp_register();  // Use the built-in help command
   cmdstat_register();  // Register our own stat command
+  cmd_stats_init(&cmdstat_stats, 0, 12); // Histogram of 16 bins of 0x1000
 
   Serial.println( );
   Serial.println( F("Type 'help' for help") );
@@ -0,0 +1,98 @@
+// helpz.h - compressed help texts, generated by helpz.py (do not edit)
+// From https://github.com/maarten-pennings/cmd
+// Sources: cmd.cpp table.ino
+// Size: 3289 -> 1722 bytes
+
+
+// The dictionary, install with cmd_set_helpdict(helpz_dict, HELPZ_DICT_COUNT)
+#define HELPZ_DICT_COUNT 128
+const uint8_t helpz_dict[] PROGMEM = {
+  0x73, 0x20, 0x69, 0x6E, 0x65, 0x20, 0x0A, 0x2D, 0x83, 0x20, 0x65, 0x64, 0x74, 0x68, 0x63, 0x68,
+  0x6F, 0x20, 0x70, 0x72, 0x2C, 0x20, 0x74, 0x20, 0x65, 0x6E, 0x61, 0x6E, 0x63, 0x6F, 0x3A, 0x20,
+  0x6C, 0x81, 0x65, 0x87, 0x74, 0x80, 0x8D, 0x64, 0x65, 0x72, 0x61, 0x72, 0x73, 0x74, 0x91, 0x88,
+  0x65, 0x73, 0x8E, 0x6D, 0x99, 0x6D, 0x6F, 0x72, 0x77, 0x69, 0x86, 0x82, 0x20, 0x89, 0x9A, 0x93,
+  0x9C, 0x86, 0x85, 0x20, 0x6F, 0x66, 0x6F, 0x77, 0x61, 0x74, 0x53, 0x59, 0xA5, 0x4E, 0xA6, 0x54,
+  0xA7, 0x41, 0xA8, 0x58, 0xA9, 0x8F, 0xA0, 0x20, 0x90, 0x82, 0x69, 0x80, 0x27, 0x97, 0x6C, 0x20,
+  0x6F, 0x6E, 0x65, 0x6C, 0x75, 0x73, 0x84, 0xAB, 0x61, 0x62, 0x8C, 0x74, 0x75, 0x6E, 0x6E, 0x88,
+  0x61, 0x63, 0x6B, 0x20, 0x66, 0x6C, 0x81, 0x92, 0x67, 0x75, 0x73, 0x68, 0x9B, 0x20, 0xBA, 0xA3,
+  0xB4, 0x6C, 0x74, 0x85, 0xA2, 0x20, 0x61, 0x20, 0x27, 0x84, 0x90, 0x65, 0x61, 0x6C, 0x0A, 0xAA,
+  0x95, 0xBC, 0xC8, 0x6D, 0xB5, 0x8A, 0x74, 0x94, 0x74, 0x69, 0x61, 0x6D, 0x67, 0x20, 0x27, 0x9E,
+  0xCF, 0xBB, 0xAE, 0xAC, 0x9F, 0x80, 0x68, 0xB1, 0xC7, 0x5B, 0xD4, 0x40, 0xD5, 0x5D, 0x93, 0x20,
+  0xB3, 0x40, 0xD8, 0x9E, 0xD9, 0x98, 0xDA, 0xCA, 0xDB, 0xB7, 0xDC, 0x66, 0xDD, 0x65, 0xDE, 0x85,
+  0xDF, 0x62, 0xE0, 0xB8, 0xB9, 0xAD, 0xE2, 0x89, 0xE3, 0x81, 0x29, 0x84, 0x94, 0x20, 0x62, 0x82,
+  0x73, 0x65, 0x65, 0x63, 0xD0, 0x27, 0xD3, 0x70, 0x65, 0x78, 0x74, 0x73, 0x75, 0x6C, 0x75, 0x8B,
+  0xBD, 0xA3, 0xF0, 0x80, 0x72, 0x98, 0x8E, 0xB6, 0x27, 0x8A, 0x79, 0x20, 0x64, 0x69, 0x75, 0x74,
+  0x87, 0x20, 0xE4, 0xC1, 0xCC, 0x6D, 0x74, 0x72, 0xC4, 0xD1, 0x81, 0x20, 0x73, 0x63, 0xFE, 0x72,
+};
+
+
+// cmdecho_longhelp compressed
+const char cmdecho_longhelpz[] PROGMEM = 
+  "\001\252\227[\305] <w\233d>...\204\211\273\306\257w\233d\200(\262efu\257\375\377ip\355)\326\227fa\356"
+  "\222[\226ep]\204\240o\357\311\312\361\327\362e\222\224r\276\363\313\263\311\214\213'\226ep\364\226ep\200"
+  "\235\224r\276\363\313\341\344t\241(f\276sil\214\213\362e\213\276\226ep\345typic\306l\365\262\241f\276"
+  "\232\266ic\244i\260 fa\356\222(s\224ia\257rx buff\346ov\224\277)\326\227[ \214\300\241| \366s\300\241"
+  "]\263\311\214\222\214\300\230/\366s\300e\200\313m\201a\257\221o\201g\204(\366s\300\241\255\262efu\257"
+  "\375\377ip\355; o\367p\357\255r\261ev\215t\212b\357\201p\357mu\370l\230s)\341\371\204\240o\357\311\214"
+  "\222\361\226\244u\200\302\313m\201a\257\221o\201g\326\227wai\213<\372e>\204wai\222<\372e> m\200(migh\213"
+  "\347\262efu\257\375\377ip\355)\212C\373l-C c\215c\261s\341\371\326\227b\244\370[ \242f | \260 ]\263\311"
+  "\214\213s\234t\207e\200b\244\370mode\217\267\221o\212\267\211ompt\212\303\226\244u\200fr\315\202af\313"
+  " ea\370\237\204\235fr\315\202\255'#<\350q> OK' \276'#<\350q> ERR <\216de>\364<\350q> \363\222from 0 ("
+  "wh\214 s\234t\207\241\260)\341\371\326\227\277 [ \242f | x\260x\242f ]\263\311\214\213\350\222\277 \216"
+  "n\373o\257(x\260x\242f \226op\200\235s\214d\346\201\226ead \302los\201\316\201p\367\345\361\327\362e\222"
+  "\235\277 \363\313s\217pea\271fil\257\302\235r\351eiv\202buff\346\327\302\235\305\212\327s\214d\346\226"
+  "ops\341\371\n"
+  "NOTES:\204\256\305\320\303whit\202\254(\206\224\202\225\202\267<w\233d>s\345\321fa\356\355\352fa\356\355"
+  "\374\277\352\277\374\214\300\205\352\214\300\205\374\366s\300\205\352\366s\300\205\374\305\352\305\374"
+  "wait\352wait\374b\244\207\352b\244\207\304\322\260 \260\202\254\225\202\350p\225\244\241b\365';' (\321"
+  "a; \227\254b'\345sub\322ma\365\347\264brevi\244\241(\256f' \255\256fa\356\355\364\256\272' \255\256\277"
+  "')\n"
+;
+
+
+// cmdhelp_longhelp compressed
+const char cmdhelp_longhelpz[] PROGMEM = 
+  "\001\252\353\204lis\222\306\257\237s\307\353 <cmd>\204give\200detail\241\353 \260 \237 <cmd>\n"
+  "NOTES:\204\306\257\322ma\365\347\275\233t\214\205\212f\276\354\315pl\202'\353\364'\323\364'he\364'h\304"
+  "\303\275\233t\214\241\237 m\262\213\347\266ique\212\322\225\202li\226\241\306ph\264e\314c\306ly\204\306"
+  "\257sub \322ma\365\347\275\233t\214\205\212f\276\354\315pl\202'\353 \353' t\210'\353 h\304n\233m\306\236"
+  "omp\213\255>>\212o\206\224\236omp\213\201\366c\244e\200\226re\315\201\316mode\204\322ma\365\347suffix"
+  "\241\253\303\232\214\213\226\225t\201\316\253//\204som\202\322supp\233\213\303@ a\200\211efix; i\213s"
+  "up\211\230\350\200o\367p\357\302\206a\213\237\204\303l\260\316r\266n\201\316\237 c\215 \347c\215c\261"
+  "l\241\253C\373l-C\n"
+;
+
+
+// cmdprof_longhelp compressed
+const char cmdprof_longhelpz[] PROGMEM = 
+  "\001\252\211\242\204\361\235\211\242i\220\316\363\313s\204\220\230\217numb\346\302\305\200\354\351u\301"
+  "\204\354\351\217\372\202\375u\200t\210spli\213\327loo\271up \206os\202\305\200(\354clud\201\316\235\237"
+  "s\345f\356l\217\207\225\200dropp\241b\351a\262\202\235\254wa\200to\210l\260g\204ov\224\277s\217r\351e"
+  "iv\202buff\346ov\224\277s\204\377\244\370peak\217high\230\213\262\202\302\235\377\244\370\225\214\303"
+  "(\350\202CMD_SCRATCH_SIZE\345p\346\237\217\201voc\244i\260s\212m\201/me\215/max \372\202\375\262\212b"
+  "yte\200\221o\241\327o\367p\367\326\211\302\362et\204\362e\222\235\211\242i\220\316\363\313s\n"
+  "NOTES:\341\371\n"
+;
+
+
+// cmdtrace_longhelp compressed
+const char cmdtrace_longhelpz[] PROGMEM = 
+  "\001\252\373\270e\204\361\235las\213\354\351\367\241\220\230\212old\230\213fir\226\204ms\217\372\202\235"
+  "\254\226\225\301\212\262\217i\222\354\351u\314\260 \372e\204\226\217\226\244u\200(0 ok\2121 no\213fo\266"
+  "d\2122 \315bi\274o\262\2123 \311\265s\212...\345\305\217\235\237 (\362olv\205) \327\235\226\225\213\302"
+  "i\222\311\265s\326\373\270\202cle\225\204cle\225\200\235\373\270e\n"
+  "NOTES:\204\303\254\206a\213\226\225\222\303tas\271\361\235\226\244u\200wh\214 i\213\226\225\301\341\371"
+  "\n"
+;
+
+
+// cmdhi_longhelp compressed
+const char cmdhi_longhelpz[] PROGMEM = 
+  "\001\252hi [<n\315e>]\204gree\222<n\315e> (\276j\262\213say\200hi)\n"
+;
+
+
+// cmdhint_longhelp compressed
+const char cmdhint_longhelpz[] PROGMEM = 
+  "\001\252h\201t\204t\261l\200wh\224\202\235\322\225\202\226\233\205\n"
+;
@@ -0,0 +1,68 @@
+// table.ino - An example for cmd; commands declared at compile time in a PROGMEM table, with compressed help
+#include "cmd.h"
+#include "helpz.h" // Generated: python3 ../../extras/helpz/helpz.py -o helpz.h ../../src/cmd.cpp table.ino
+
+
+// The command "hi" ========================================================================
+
+
+void cmdhi_main(int argc, char * argv[]) {
+  if( argc==1 ) cmd_out.print(F("hi\n")); else { cmd_out.print(F("hi ")); cmd_out.print(argv[1]); cmd_out.print(F("\n")); }
+}
+
+
+// The help text is compressed by helpz.py to cmdhi_longhelpz (so this one is not linked in)
+const char cmdhi_longhelp[] PROGMEM =
+  "SYNTAX: hi [<name>]\n"
+  "- greets <name> (or just says hi)\n"
+;
+
+
+// The command "hint" (registered at runtime) =============================================
+
+
+void cmdhint_main(int argc, char * argv[]) {
+  (void)argc; (void)argv;
+  cmd_out.print(F("'hi' and 'help' are in flash, 'hint' is in RAM\n"));
+}
+
+
+// Also compressed (to cmdhint_longhelpz)
+const char cmdhint_longhelp[] PROGMEM =
+  "SYNTAX: hint\n"
+  "- tells where the commands are stored\n"
+;
+
+
+// The table ===============================================================================
+
+
+// All commands known at compile time; must be in alphabetical order (checked by the compiler)
+#define TABLE_CMDS(X) \
+  X( echo, cmdecho_main, "echo a message (or en/disables echoing)", cmdecho_longhelpz ) \
+  X( help, cmdhelp_main, "gives help (try 'help help')", cmdhelp_longhelpz ) \
+  X( hi,   cmdhi_main,   "greets", cmdhi_longhelpz )
+CMD_TABLE(table_cmds, TABLE_CMDS)
+
+
+// The main program ========================================================================
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.table") );
+  
+  cmd_init();
+  cmd_register_table(table_cmds, CMD_TABLE_COUNT(table_cmds)); // No RAM per command
+  cmd_set_helpdict(helpz_dict, HELPZ_DICT_COUNT); // For the compressed help texts
+  cmd_register(cmdhint_main, PSTR("hint"), PSTR("tells where the commands are stored"), cmdhint_longhelpz); // Dynamic addition
+  Serial.println( );
+
+  Serial.println( F("Type 'help' for help") );
+  cmd_prompt();
+}
+
+
+void loop() {
+  cmd_pollserial();
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+# helpz.py - compresses the help texts of cmd (see cmd_set_helpdict in cmd.h)
+# From https://github.com/maarten-pennings/cmd
+#
+# Usage: python3 helpz.py [-o helpz.h] [-m REGEX] [-p PREFIX] FILE...
+#
+# Scans the FILEs for help texts, that is for PROGMEM strings like
+#   const char cmdstat_longhelp[] PROGMEM = "SYNTAX: stat\n" "- shows the statistics\n";
+# whose name matches REGEX (default 'longhelp$'). It compresses them with one shared dictionary 
+# (Re-Pair: repeatedly replace the most frequent pair of symbols by a new symbol), checks that each 
+# text decompresses to the original (with the same algorithm as cmd_helpprint), reports the savings, 
+# and writes a header with the dictionary and the compressed texts (NAME becomes NAMEz).
+# Use it in the sketch as follows:
+#   #include "helpz.h"
+#   cmd_set_helpdict(helpz_dict, HELPZ_DICT_COUNT);
+#   cmd_register(cmdstat_main, PSTR("stat"), PSTR("compute statistics"), cmdstat_longhelpz);
+
+
+import argparse
+import re
+import sys
+
+
+MARK  = 0x01 # CMD_HELPZ_MARK
+DEPTH = 16   # CMD_HELPZ_DEPTH
+FIRST = 0x80 # First dictionary symbol
+MAXSYM= 128  # Number of dictionary symbols
+
+
+# Finds the PROGMEM string definitions in C source `src`; returns a list of (name,bytes)
+def extract(src, match) :
+  texts= []
+  for m in re.finditer(r'const\s+char\s+(\w+)\s*\[\s*\]\s*PROGMEM\s*=\s*((?:"(?:[^"\\]|\\.)*"\s*)+);', src) :
+    name= m.group(1)
+    if not re.search(match, name) : continue
+    lits= re.findall(r'"((?:[^"\\]|\\.)*)"', m.group(2))
+    texts.append( (name, unescape("".join(lits))) )
+  return texts
+
+
+# Converts the body of a C string literal to bytes
+def unescape(s) :
+  out= bytearray()
+  i= 0
+  simple= { 'n':10, 't':9, 'r':13, 'a':7, 'b':8, 'f':12, 'v':11, '\\':92, '"':34, "'":39, '?':63 }
+  while i<len(s) :
+    c= s[i]
+    if c!='\\' :
+      out+= c.encode('latin-1')
+      i+= 1
+    elif s[i+1] in simple :
+      out.append(simple[s[i+1]])
+      i+= 2
+    elif s[i+1]=='x' :
+      m= re.match(r'[0-9a-fA-F]+', s[i+2:])
+      out.append(int(m.group(0),16) & 0xFF)
+      i+= 2+len(m.group(0))
+    else :
+      m= re.match(r'[0-7]{1,3}', s[i+1:])
+      out.append(int(m.group(0),8) & 0xFF)
+      i+= 1+len(m.group(0))
+  return bytes(out)
+
+
+# Compresses `texts` (list of bytes); returns the dictionary (list of pairs) and the compressed texts (lists of symbols)
+def compress(texts) :
+  seqs= [ list(t) for t in texts ]
+  pairs= []
+  depth= {}  # depth of each dictionary symbol (a char has depth 0)
+  while len(pairs)<MAXSYM :
+    # Count the (non-overlapping) pairs
+    count= {}
+    for seq in seqs :
+      prev= None
+      for i in range(len(seq)-1) :
+        p= (seq[i],seq[i+1])
+        if p==prev : prev= None; continue # "aaa" has one "aa" that can be replaced
+        count[p]= count.get(p,0)+1
+        prev= p
+    # Take the most frequent pair that is not too deep; it gains count-2 bytes (the pair itself costs 2)
+    best= None
+    for p,n in sorted(count.items(), key=lambda pn: -pn[1]) :
+      if n<3 : break
+      d= 1+max(depth.get(p[0],0),depth.get(p[1],0))
+      if d<DEPTH-1 : best= p; break
+    if best is None : break
+    sym= FIRST+len(pairs)
+    pairs.append(best)
+    depth[sym]= 1+max(depth.get(best[0],0),depth.get(best[1],0))
+    # Replace it everywhere
+    for k,seq in enumerate(seqs) :
+      out= []
+      i= 0
+      while i<len(seq) :
+        if i+1<len(seq) and (seq[i],seq[i+1])==best : out.append(sym); i+= 2
+        else : out.append(seq[i]); i+= 1
+      seqs[k]= out
+  return pairs, seqs
+
+
+# Decompresses `seq` with `pairs` exactly like cmd_helpprint() does (including its stack limit)
+def decompress(pairs, seq) :
+  out= bytearray()
+  for b in seq :
+    stack= [b]
+    while stack :
+      b= stack.pop()
+      if b<FIRST : out.append(b)
+      elif b-FIRST<len(pairs) and len(stack)+2<=DEPTH : stack.append(pairs[b-FIRST][1]); stack.append(pairs[b-FIRST][0])
+      else : out.append(ord('?'))
+  return bytes(out)
+
+
+# Formats `data` as C initializer lines
+def carray(data, indent="  ") :
+  lines= []
+  for i in range(0,len(data),16) :
+    lines.append( indent + ", ".join("0x%02X"%b for b in data[i:i+16]) + "," )
+  return "\n".join(lines)
+
+
+# Formats `data` as C string literal lines (a line per \n); chars are kept readable, other bytes are 3-digit octal
+def cstring(data, indent="  ") :
+  lines= []
+  line= ""
+  for b in data :
+    if b==10 : line+= "\\n"
+    elif b==34 or b==92 or b==63 : line+= "\\"+chr(b)
+    elif 32<=b<127 : line+= chr(b)
+    else : line+= "\\%03o" % b
+    if b==10 or len(line)>100 : lines.append(indent+'"'+line+'"'); line= ""
+  if line : lines.append(indent+'"'+line+'"')
+  return "\n".join(lines)
+
+
+def main() :
+  parser= argparse.ArgumentParser(description="Compresses the help texts of cmd")
+  parser.add_argument("files", nargs="+", help="C/C++ sources with help texts")
+  parser.add_argument("-o", "--output", help="header to generate (default: only report)")
+  parser.add_argument("-m", "--match", default="longhelp$", help="regex for the names of the help texts (default 'longhelp$')")
+  parser.add_argument("-p", "--prefix", default="helpz", help="prefix of the dictionary name (default 'helpz')")
+  args= parser.parse_args()
+
+  texts= []
+  for fn in args.files :
+    with open(fn, encoding="latin-1") as f : texts+= extract(f.read(), args.match)
+  if not texts : sys.exit("helpz: no help texts found")
+  for name,text in texts :
+    if any(b>=FIRST or b==MARK or b==0 for b in text) : sys.exit("helpz: %s: only 7-bit chars (except 0x00 and 0x01) can be compressed" % name)
+
+  pairs, seqs= compress([t for n,t in texts])
+
+  # Check and report
+  total_in= 0
+  total_out= 2*len(pairs)
+  for (name,text),seq in zip(texts,seqs) :
+    if decompress(pairs,seq)!=text : sys.exit("helpz: %s: round trip failed" % name)
+    size_in= len(text)+1   # with terminator
+    size_out= len(seq)+2   # with mark and terminator
+    total_in+= size_in
+    total_out+= size_out
+    print("helpz: %-24s %5d -> %5d bytes" % (name, size_in, size_out))
+  print("helpz: %-24s %5s -> %5d bytes (%d pairs)" % ("(dictionary)", "", 2*len(pairs), len(pairs)))
+  print("helpz: %-24s %5d -> %5d bytes (%d%% saved), round trip ok" % ("total", total_in, total_out, 100-100*total_out//total_in))
+
+  if args.output :
+    with open(args.output, "w", newline="\r\n") as f :
+      f.write("// %s - compressed help texts, generated by helpz.py (do not edit)\n" % args.output.split("/")[-1])
+      f.write("// From https://github.com/maarten-pennings/cmd\n")
+      f.write("// Sources: %s\n" % " ".join(fn.split("/")[-1] for fn in args.files))
+      f.write("// Size: %d -> %d bytes\n\n\n" % (total_in, total_out))
+      f.write("// The dictionary, install with cmd_set_helpdict(%s_dict, %s_DICT_COUNT)\n" % (args.prefix, args.prefix.upper()))
+      f.write("#define %s_DICT_COUNT %d\n" % (args.prefix.upper(), len(pairs)))
+      f.write("const uint8_t %s_dict[] PROGMEM = {\n%s\n};\n" % (args.prefix, carray([b for p in pairs for b in p])))
+      for (name,text),seq in zip(texts,seqs) :
+        f.write("\n\n")
+        f.write("// %s compressed\n" % name)
+        f.write("const char %sz[] PROGMEM = \n%s\n;\n" % (name, cstring([MARK]+seq)))
+
+
+if __name__=="__main__" :
+  main()
@@ -0,0 +1,174 @@
+// Arduino.cpp - minimal Arduino shim so that cmd (and its examples) compile and run on a Linux host
+// From https://github.com/maarten-pennings/cmd
+
+
+#include <Arduino.h>
+#include "cmd.h" // cmd_task_active(), cmd_outflush() for main()
+#include <poll.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Timing ================================================================================
+
+
+static uint64_t host_now_us( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000u + ts.tv_nsec/1000;
+}
+
+
+static uint64_t host_start_us= host_now_us();
+
+
+unsigned long micros(void) {
+  return (unsigned long)(host_now_us() - host_start_us);
+}
+
+
+unsigned long millis(void) {
+  return (unsigned long)((host_now_us() - host_start_us)/1000);
+}
+
+
+void delay(unsigned long ms) {
+  usleep(ms*1000);
+}
+
+
+void delayMicroseconds(unsigned int us) {
+  usleep(us);
+}
+
+
+// On the host there is no watchdog or background work; let other processes run
+void yield(void) {
+  sched_yield();
+}
+
+
+// Print and Stream ======================================================================
+
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[8*sizeof(long)+1];
+  char * s= &buf[sizeof(buf)-1];
+  *s= '\0';
+  if( base<2 ) base= 10;
+  do { int d= n%base; *--s= d<10 ? '0'+d : 'A'+d-10; n/= base; } while( n>0 );
+  return write(s);
+}
+
+
+size_t Print::print(long n, int base) {
+  if( base==10 && n<0 ) return print('-') + print((unsigned long)-n, 10);
+  return print((unsigned long)n, base);
+}
+
+
+size_t Print::print(double d, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof buf, "%.*f", digits, d);
+  return write(buf);
+}
+
+
+// Reads up to `size` bytes, waiting (up to the timeout) for them; it sleeps between attempts instead of spinning.
+size_t Stream::readBytes(char * buf, size_t size) {
+  size_t n= 0;
+  unsigned long start= millis();
+  while( n<size ) {
+    int ch= read();
+    if( ch<0 ) {
+      if( millis()-start>=_timeout ) break;
+      delay(1);
+      continue;
+    }
+    buf[n++]= ch;
+  }
+  return n;
+}
+
+
+// Serial ================================================================================
+
+
+HostSerial Serial;
+
+
+// Returns the number of bytes pending on stdin (FIONREAD), like the fill level of a UART receive buffer.
+// At end-of-file (nothing pending, but stdin is readable) it returns 1, so that read() finds out.
+int HostSerial::available() {
+  if( _eof ) return _peek>=0 ? 1 : 0;
+  int n= 0;
+  if( ioctl(0, FIONREAD, &n)<0 || n<=0 ) {
+    struct pollfd pfd= { 0, POLLIN, 0 };
+    n= poll(&pfd, 1, 0)>0 ? 1 : 0;
+  }
+  return n + (_peek>=0 ? 1 : 0);
+}
+
+
+int HostSerial::read() {
+  if( _peek>=0 ) { int ch= _peek; _peek= -1; return ch; }
+  if( !available() ) return -1;
+  unsigned char ch;
+  if( ::read(0, &ch, 1)!=1 ) { _eof= true; return -1; }
+  return ch;
+}
+
+
+// Reads what is pending with one read(), like copying from a UART receive buffer; waits for the rest (up to the timeout), 
+// sleeping in poll() until stdin is readable.
+size_t HostSerial::readBytes(char * buf, size_t size) {
+  size_t n= 0;
+  if( n<size && _peek>=0 ) { buf[n++]= _peek; _peek= -1; }
+  int avail= n<size ? available() : 0;
+  if( avail>0 ) {
+    ssize_t r= ::read(0, buf+n, (size_t)avail<size-n ? avail : size-n);
+    if( r==0 ) _eof= true; else if( r>0 ) n+= r;
+  }
+  unsigned long start= millis();
+  while( n<size && !_eof ) {
+    unsigned long waited= millis()-start;
+    if( waited>=_timeout ) break;
+    struct pollfd pfd= { 0, POLLIN, 0 };
+    if( poll(&pfd, 1, (int)(_timeout-waited))<=0 ) continue; // Timeout (or signal): the loop checks the time
+    ssize_t r= ::read(0, buf+n, size-n);
+    if( r==0 ) _eof= true; else if( r>0 ) n+= r;
+  }
+  return n;
+}
+
+
+int HostSerial::peek() {
+  if( _peek<0 ) _peek= read();
+  return _peek;
+}
+
+
+size_t HostSerial::write(uint8_t ch) {
+  return fwrite(&ch, 1, 1, stdout);
+}
+
+
+size_t HostSerial::write(const uint8_t * buf, size_t size) {
+  return fwrite(buf, 1, size, stdout);
+}
+
+
+// Main ==================================================================================
+
+
+// Runs the sketch until stdin is closed, and then on until the input read before is done: 
+// the task of the (default) instance may still run, with type-ahead waiting for it.
+int main( void ) {
+  setup();
+  while( !Serial.eof() || Serial.available()>0 || cmd_task_active() ) loop();
+  cmd_outflush();
+  fflush(stdout);
+  return 0;
+}
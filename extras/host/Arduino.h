@@ -0,0 +1,136 @@
+// Arduino.h - minimal Arduino shim so that cmd (and its examples) compile and run on a Linux host
+// From https://github.com/maarten-pennings/cmd
+#ifndef __ARDUINO_H__
+#define __ARDUINO_H__
+
+
+// This is NOT a full Arduino core. It only offers what cmd.cpp and the examples use:
+// Serial (on stdin/stdout), PROGMEM access (flash is just RAM on a host), and timing.
+// See README.md section "Host build" for how to compile.
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+
+// Tell sketches and library they are on a host
+#define CMD_HOST 1
+
+
+typedef uint8_t byte;
+
+
+// PROGMEM emulation: on a host flash and RAM are the same address space
+#define PROGMEM
+#define PGM_P              const char *
+#define PSTR(s)            (s)
+#define pgm_read_byte(p)   (*(const uint8_t *)(p))
+#define pgm_read_word(p)   (*(const uint16_t *)(p))
+#define pgm_read_dword(p)  (*(const uint32_t *)(p))
+#define pgm_read_ptr(p)    (*(void * const *)(p))
+#define strlen_P           strlen
+#define strcmp_P           strcmp
+#define strncmp_P          strncmp
+#define memcpy_P           memcpy
+#define vsnprintf_P        vsnprintf
+#define snprintf_P         snprintf
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+
+// Timing (relative to program start)
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+
+// Digital pins (only for RTS flow control; they do nothing on a host)
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+inline void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+inline void digitalWrite(uint8_t pin, uint8_t val) { (void)pin; (void)val; }
+
+
+// Default size of the emulated UART receive buffer (used by cmd_pollserial to guess overflows)
+#define SERIAL_RX_BUFFER_SIZE 64
+
+
+// Print, much like the Arduino core version
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t ch) = 0;
+    virtual size_t write(const uint8_t * buf, size_t size) { size_t n=0; while( size-- ) n+= write(*buf++); return n; }
+    size_t write(const char * str) { return str==0 ? 0 : write((const uint8_t *)str, strlen(str)); }
+    size_t write(const char * buf, size_t size) { return write((const uint8_t *)buf, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper * s) { return write((const char *)s); }
+    size_t print(const char * s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base=10) { return print((long)n, base); }
+    size_t print(unsigned n, int base=10) { return print((unsigned long)n, base); }
+    size_t print(long n, int base=10);
+    size_t print(unsigned long n, int base=10);
+    size_t print(double d, int digits=2);
+
+    size_t println(void) { return write('\r')+write('\n'); }
+    template<typename T> size_t println(T v) { size_t n= print(v); return n+println(); }
+    template<typename T> size_t println(T v, int x) { size_t n= print(v,x); return n+println(); }
+};
+
+
+// Stream, much like the Arduino core version
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long ms) { _timeout= ms; }
+    virtual size_t readBytes(char * buf, size_t size);
+    size_t readBytes(uint8_t * buf, size_t size) { return readBytes((char *)buf, size); }
+  protected:
+    unsigned long _timeout= 1000;
+};
+
+
+// Serial port emulated on stdin (non-blocking) and stdout
+class HostSerial : public Stream {
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    operator bool() { return true; }
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual size_t readBytes(char * buf, size_t size);
+    using Stream::readBytes;
+    virtual size_t write(uint8_t ch);
+    virtual size_t write(const uint8_t * buf, size_t size);
+    virtual int availableForWrite() { return 4096; }
+    virtual void flush() { fflush(stdout); }
+    using Print::write;
+    bool eof() { return _eof; } // Host only: stdin reached end-of-file
+  private:
+    int  _peek= -1;
+    bool _eof= false;
+};
+extern HostSerial Serial;
+
+
+// The sketch
+void setup(void);
+void loop(void);
+
+
+#endif
@@ -0,0 +1,122 @@
+// HostFd.cpp - event-driven driver for cmd on a Linux host: instances on file descriptors (pty, socket, pipe), with epoll
+// From https://github.com/maarten-pennings/cmd
+
+
+#include <HostFd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+// Stream ================================================================================
+
+
+size_t HostFdStream::write(const uint8_t * buf, size_t size) {
+  size_t n= 0;
+  while( n<size ) {
+    ssize_t res= ::write(_fd, buf+n, size-n);
+    if( res<0 && errno==EINTR ) continue;
+    if( res<=0 ) break; // Peer gone; drop the output
+    n+= res;
+  }
+  return n;
+}
+
+
+// Pseudo terminal =======================================================================
+
+
+int host_openpty( char * name, size_t size ) {
+  int master= posix_openpt(O_RDWR | O_NOCTTY);
+  if( master<0 ) return -1;
+  if( grantpt(master)!=0 || unlockpt(master)!=0 || ptsname_r(master, name, size)!=0 ) { close(master); return -1; }
+  // Keep the slave open (never closed), and make it raw: the interpreter does the echo and the line editing
+  int slave= open(name, O_RDWR | O_NOCTTY);
+  if( slave<0 ) { close(master); return -1; }
+  struct termios tio;
+  if( tcgetattr(slave, &tio)==0 ) { cfmakeraw(&tio); tcsetattr(slave, TCSANOW, &tio); }
+  return master;
+}
+
+
+// Event loop ============================================================================
+
+
+// The epoll instance, and the added file descriptors with their interpreter instance
+// (paused: taken out of epoll, because the instance takes no input, see cmd_feedroom)
+static int host_epfd= -1;
+static struct { cmd_t * cmd; int fd; bool paused; } host_fds[HOST_MAXFDS];
+static int host_count= 0;
+
+
+bool host_add( cmd_t * cmd, int fd ) {
+  if( host_count==HOST_MAXFDS ) return false;
+  if( host_epfd<0 ) host_epfd= epoll_create1(EPOLL_CLOEXEC);
+  if( host_epfd<0 ) return false;
+  struct epoll_event ev;
+  ev.events= EPOLLIN;
+  ev.data.fd= fd;
+  if( epoll_ctl(host_epfd, EPOLL_CTL_ADD, fd, &ev)!=0 ) return false;
+  host_fds[host_count].cmd= cmd;
+  host_fds[host_count].fd= fd;
+  host_fds[host_count].paused= false;
+  host_count++;
+  return true;
+}
+
+
+// Removes entry `ix` (its file descriptor reached end-of-file or hung up)
+static void host_remove( int ix ) {
+  if( !host_fds[ix].paused ) epoll_ctl(host_epfd, EPOLL_CTL_DEL, host_fds[ix].fd, 0);
+  host_fds[ix]= host_fds[--host_count];
+}
+
+
+bool host_open( int fd ) {
+  for( int i=0; i<host_count; i++ ) if( host_fds[i].fd==fd ) return true;
+  return false;
+}
+
+
+int host_step( void ) {
+  if( host_count==0 ) return 0;
+  // Input of an instance without room stays in the file descriptor (in the kernel) until there is room again
+  for( int i=0; i<host_count; i++ ) {
+    bool full= cmd_feedroom(host_fds[i].cmd)==0;
+    if( full==host_fds[i].paused ) continue;
+    struct epoll_event ev;
+    ev.events= EPOLLIN;
+    ev.data.fd= host_fds[i].fd;
+    epoll_ctl(host_epfd, full ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, host_fds[i].fd, &ev);
+    host_fds[i].paused= full;
+  }
+  // Sleep until input, or until the first instance with a task (or queued output) needs a step
+  int timeout= -1;
+  for( int i=0; i<host_count; i++ ) {
+    int ms= cmd_waitms(host_fds[i].cmd);
+    if( ms>=0 && (timeout<0 || ms<timeout) ) timeout= ms;
+  }
+  fflush(stdout); // Serial (stdout) is buffered
+  struct epoll_event evs[HOST_MAXFDS];
+  int n= epoll_wait(host_epfd, evs, HOST_MAXFDS, timeout);
+  if( n<0 && errno!=EINTR ) { perror("epoll_wait"); return host_count=0; }
+  // Feed the input
+  for( int e=0; e<n; e++ ) {
+    int i= 0;
+    while( i<host_count && host_fds[i].fd!=evs[e].data.fd ) i++;
+    if( i==host_count ) continue;
+    char buf[HOST_READSIZE];
+    int room= cmd_feedroom(host_fds[i].cmd);
+    if( room==0 ) continue; // Not paused yet (a read of 0 bytes would look like end-of-file)
+    ssize_t len= read(host_fds[i].fd, buf, room<(int)sizeof buf ? room : sizeof buf);
+    if( len>0 ) cmd_feed(host_fds[i].cmd, buf, len);
+    else if( len==0 || (errno!=EINTR && errno!=EAGAIN) ) host_remove(i); // End-of-file (or EIO: pty hung up)
+  }
+  // Step tasks and drain output of the instances without input
+  for( int i=0; i<host_count; i++ ) {
+    if( cmd_waitms(host_fds[i].cmd)>=0 ) cmd_feed(host_fds[i].cmd, 0, 0);
+  }
+  return host_count;
+}
@@ -0,0 +1,55 @@
+// HostFd.h - event-driven driver for cmd on a Linux host: instances on file descriptors (pty, socket, pipe), with epoll
+// From https://github.com/maarten-pennings/cmd
+#ifndef __HOSTFD_H__
+#define __HOSTFD_H__
+
+
+// Instead of loop() calling cmd_pollserial() over and over (busy polling), host_step() sleeps in epoll_wait()
+// until one of the file descriptors has input, and feeds it with cmd_feed(). When no task runs, there is no
+// timeout, so an idle interpreter uses no CPU. See README.md section "Host build" and the example in extras/host/epoll.
+
+
+#include <Arduino.h>
+#include "cmd.h"
+
+
+// Maximum number of file descriptors host_add() accepts
+#define HOST_MAXFDS 8
+// Size of the chunks read from a file descriptor (on the stack)
+#define HOST_READSIZE 256
+
+
+// A Stream that writes to a file descriptor (blocking); its input is read by host_step(), not via the Stream.
+class HostFdStream : public Stream {
+  public:
+    HostFdStream( int fd=-1 ) : _fd(fd) {}
+    void setfd( int fd ) { _fd= fd; }
+    int  getfd( void ) { return _fd; }
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t write(uint8_t ch) { return write(&ch, 1); }
+    virtual size_t write(const uint8_t * buf, size_t size);
+    virtual int availableForWrite() { return 4096; }
+    using Print::write;
+  private:
+    int _fd;
+};
+
+
+// Opens a pseudo terminal in raw mode. Returns its master file descriptor (or -1), and the name of its
+// slave in `name` (e.g. "/dev/pts/3"), where a terminal program connects (e.g. "screen /dev/pts/3").
+// The slave is kept open, so that the master does not hang up when a terminal program disconnects.
+int  host_openpty( char * name, size_t size );
+// Adds instance `cmd` (initialized, with a stream for its output) with input file descriptor `fd` to the event loop.
+// Returns false when there are already HOST_MAXFDS, or epoll fails.
+bool host_add( cmd_t * cmd, int fd );
+// Sleeps until one of the added file descriptors has input (or a task needs a step), and feeds the input to its
+// instance with cmd_feed(). A file descriptor that reaches end-of-file or hangs up is removed.
+// Returns the number of file descriptors left.
+int  host_step( void );
+// Returns true iff `fd` is (still) in the event loop.
+bool host_open( int fd );
+
+
+#endif
@@ -0,0 +1,331 @@
+// check.ino - A host-only example for cmd: checks library functions against reference results, exits with 1 when a check fails
+#include "cmd.h"
+#include <errno.h>
+#include <limits.h>
+
+
+#if !CMD_HOST
+#error This example is for the host build only (see README.md section "Host build")
+#endif
+
+
+// Checking ===============================================================================
+
+
+int check_passed;
+int check_failed;
+
+
+// Counts `ok`; when it is false, prints `what` (and the location) so that the failure can be found
+#define CHECK(ok, what) check_one( (ok), __LINE__, what )
+static void check_one(bool ok, int line, const char * what) {
+  if( ok ) { check_passed++; return; }
+  check_failed++;
+  Serial.print(F("check: FAILED line ")); Serial.print(line); Serial.print(F(": ")); Serial.println(what);
+}
+
+
+// Statistics =============================================================================
+
+
+// Values at the ends of the int32 range must land in the first or last bin, whatever the bounds
+static void check_stats() {
+  static cmd_stats_t stats;
+  // lo=INT32_MIN: INT32_MAX-lo needs 32 bits
+  cmd_stats_init(&stats, INT32_MIN, 0);
+  cmd_stats_add(&stats, INT32_MIN);
+  cmd_stats_add(&stats, INT32_MAX);
+  cmd_stats_add(&stats, INT32_MIN+1);
+  CHECK( stats.count==3, "stats: count" );
+  CHECK( stats.min==INT32_MIN && stats.max==INT32_MAX, "stats: min/max at INT32 ends" );
+  CHECK( stats.bins[0]==1 && stats.bins[1]==1, "stats: low bins for lo=INT32_MIN" );
+  CHECK( stats.bins[CMD_STATS_BINS-1]==1, "stats: INT32_MAX clamped in last bin for lo=INT32_MIN" );
+  // Wide bins: (INT32_MAX-INT32_MIN)>>31 is 1
+  cmd_stats_init(&stats, INT32_MIN, 31);
+  cmd_stats_add(&stats, INT32_MAX);
+  CHECK( stats.bins[1]==1, "stats: INT32_MAX in bin 1 for shift=31" );
+  // lo=0: INT32_MIN is below, INT32_MAX far above
+  cmd_stats_init(&stats, 0, 4);
+  for( int i=0; i<20; i++ ) { cmd_stats_add(&stats, INT32_MIN); cmd_stats_add(&stats, INT32_MAX); }
+  CHECK( stats.bins[0]==20 && stats.bins[CMD_STATS_BINS-1]==20, "stats: INT32 ends in first and last bin for lo=0" );
+  int32_t p50= cmd_stats_quantile(&stats, 0);
+  CHECK( p50>=INT32_MIN && p50<=INT32_MAX, "stats: quantile in range" );
+  uint16_t total= 0;
+  for( int b=0; b<CMD_STATS_BINS; b++ ) total+= stats.bins[b];
+  CHECK( total==40, "stats: no value counted outside the bins" );
+}
+
+
+// Parsing ================================================================================
+
+
+// Reference for cmd_parse_dec(): an optional sign, one or more decimal digits, and within int
+static bool ref_parse_dec(const char * s, int * v) {
+  const char * d= s[0]=='+' || s[0]=='-' ? s+1 : s;
+  if( *d=='\0' || strspn(d,"0123456789")!=strlen(d) ) return false;
+  errno= 0;
+  long l= strtol(s, 0, 10);
+  if( errno==ERANGE || l<INT_MIN || l>INT_MAX ) return false;
+  *v= (int)l;
+  return true;
+}
+
+
+// Reference for cmd_parse_hex() and cmd_parse_hex32(): one or more hex digits (no sign, no 0x), and at most `max`
+static bool ref_parse_hex(const char * s, unsigned long max, unsigned long * v) {
+  if( *s=='\0' || strspn(s,"0123456789abcdefABCDEF")!=strlen(s) ) return false;
+  errno= 0;
+  unsigned long l= strtoul(s, 0, 16);
+  if( errno==ERANGE || l>max ) return false;
+  *v= l;
+  return true;
+}
+
+
+// Checks the parse functions on `s` against the references
+static void check_parse_one(const char * s) {
+  char what[80];
+  int dv= 0, rdv= 0;
+  bool dok= cmd_parse_dec(s,&dv), rdok= ref_parse_dec(s,&rdv);
+  snprintf(what, sizeof what, "parse: dec '%s'", s);
+  CHECK( dok==rdok && (!dok || dv==rdv), what );
+  uint16_t hv= 0; unsigned long rhv= 0;
+  bool hok= cmd_parse_hex(s,&hv), rhok= ref_parse_hex(s,0xFFFF,&rhv);
+  snprintf(what, sizeof what, "parse: hex '%s'", s);
+  CHECK( hok==rhok && (!hok || hv==rhv), what );
+  #if CMD_HEX32
+    uint32_t h32= 0; unsigned long rh32= 0;
+    bool h32ok= cmd_parse_hex32(s,&h32), rh32ok= ref_parse_hex(s,0xFFFFFFFFUL,&rh32);
+    snprintf(what, sizeof what, "parse: hex32 '%s'", s);
+    CHECK( h32ok==rh32ok && (!h32ok || h32==rh32), what );
+  #endif
+}
+
+
+// The edge cases, and random strings and numbers (a fixed sequence, so that a failure can be reproduced)
+static void check_parse() {
+  static const char * const edges[]= {
+    "", "+", "-", "0", "-0", "+0", "00", "1", "-1", "12a", " 1", "1 ", "0x10", "1-", "--1", "+-1",
+    "2147483647", "2147483648", "-2147483648", "-2147483649", "00000000002147483647", "-0000000000002147483648",
+    "4294967295", "4294967296", "99999999999", "999999999999999999999999",
+    "FFFF", "ffff", "10000", "0000FFFF", "000000000000ffff", "FFFFFFFF", "100000000", "0FFFFFFFF", "fffffffff",
+    "/", ":", "@", "G", "`", "g", "9:", "f@", "\xb0", "1\xb0", "\x80\x80\x80\x80",
+  };
+  for( size_t i=0; i<sizeof edges/sizeof edges[0]; i++ ) check_parse_one(edges[i]);
+  static const char alphabet[]= "0123456789abcdefABCDEF+-gG:/@` ";
+  uint32_t seed= 12345;
+  for( int i=0; i<20000; i++ ) {
+    char s[24];
+    seed= seed*1103515245+12345;
+    if( i%2 ) {
+      int len= (seed>>16)%14;
+      for( int k=0; k<len; k++ ) { seed= seed*1103515245+12345; s[k]= alphabet[(seed>>16)%(sizeof alphabet-1)]; }
+      s[len]= '\0';
+    } else {
+      seed= seed*1103515245+12345;
+      long long n= (long long)(int32_t)seed * ((seed>>3)%3==0 ? 3 : 1); // Also beyond int
+      snprintf(s, sizeof s, i%4==0 ? "%lld" : "%llx", n<0 && i%4!=0 ? -n : n);
+    }
+    check_parse_one(s);
+  }
+  // The array variants stop at the first bad token
+  const char * toks[]= { "12", "-7", "x", "3" };
+  int dvals[4]; uint16_t hvals[4];
+  CHECK( cmd_parse_dec_array(4,(char **)toks,dvals)==2 && dvals[0]==12 && dvals[1]==-7, "parse: dec array" );
+  CHECK( cmd_parse_hex_array(1,(char **)toks,hvals)==1 && hvals[0]==0x12, "parse: hex array" );
+  CHECK( cmd_parse_hex_array(2,(char **)toks,hvals)==1, "parse: hex array stops at '-7'" );
+  CHECK( cmd_parse_dec_array(0,(char **)toks,dvals)==0, "parse: empty array" );
+}
+
+
+// Printf =================================================================================
+
+
+// A stream that collects its output
+class CaptureStream : public Stream {
+  public:
+    char buf[1024];
+    int  len;
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t write(uint8_t ch) { return write(&ch, 1); }
+    virtual size_t write(const uint8_t * b, size_t size) { for( size_t i=0; i<size; i++ ) if( len<(int)sizeof buf ) buf[len++]= b[i]; return size; }
+    virtual int availableForWrite() { return 0x7FFF; }
+    using Print::write;
+};
+CaptureStream capture;
+cmd_t         check_cmd;
+
+
+// Checks that cmd_printf() prints (and returns) the same as snprintf()
+#define CHECK_PRINTF(what, ...) do { \
+    char want[600]; \
+    int n= snprintf(want, sizeof want, __VA_ARGS__); \
+    capture.len= 0; \
+    cmd_t * prev= cmd_select(&check_cmd); \
+    int got= cmd_printf(__VA_ARGS__); \
+    cmd_outflush(); \
+    cmd_select(prev); \
+    CHECK( got==n && capture.len==n && memcmp(capture.buf,want,n)==0, what ); \
+  } while(0)
+
+
+// Checks that cmd_printf() prints (and returns) `want`; for formats that snprintf() prints differently (%S)
+#define CHECK_PRINTF_WANT(what, want, ...) do { \
+    int n= strlen(want); \
+    capture.len= 0; \
+    cmd_t * prev= cmd_select(&check_cmd); \
+    int got= cmd_printf(__VA_ARGS__); \
+    cmd_outflush(); \
+    cmd_select(prev); \
+    CHECK( got==n && capture.len==n && memcmp(capture.buf,want,n)==0, what ); \
+  } while(0)
+
+
+// Output that fits in scratch is formatted at once, longer output piece by piece
+static void check_printf() {
+  cmd_init(&check_cmd, &capture, 0);
+  char big[400];
+  memset(big, 'x', sizeof big-1); big[sizeof big-1]= '\0';
+  CHECK_PRINTF("printf: short", "%d %s %5.1f|%-4x|%c%%", -12, "ab", 3.25, 0xAB, 'z');
+  CHECK_PRINTF("printf: long string", "<%s>", big);
+  CHECK_PRINTF("printf: long with conversions", "%s|%d|%i|%u|%x|%X|%o|%c|%%|%5s|%-5s|%.2s|%08.3f|%e|%g", 
+    big, INT32_MIN, 42, 4000000000u, 0xBEEFu, 0xBEEFu, 8u, 'q', "ab", "cd", "efgh", -3.14159, 1e-20, 2.5);
+  CHECK_PRINTF("printf: long with lengths", "%s|%ld|%lu|%lld|%llu|%hd|%hhu|%zu|%jd|%td", 
+    big, -1234567L, 1234567UL, -123456789012LL, 123456789012ULL, (short)-5, (unsigned char)200, (size_t)77, (intmax_t)-9, (ptrdiff_t)3);
+  CHECK_PRINTF("printf: long with stars", "%s|%*d|%-*d|%.*f|%*.*s", big, 6, 42, 6, 42, 2, 1.005, 8, 3, "abcdef");
+  CHECK_PRINTF("printf: long with padding", "%s|%10s|%-10s|%.0s|%%|%5c", big, "r", "l", "gone", 'c');
+  // %S is a PROGMEM string, also when the output fits
+  CHECK_PRINTF_WANT("printf: short with %S", "ab|cd  |e|%S", "%S|%-4S|%.1S|%%S", PSTR("ab"), PSTR("cd"), PSTR("ef"));
+  char want[sizeof big+8];
+  snprintf(want, sizeof want, "%s|ab", big);
+  CHECK_PRINTF_WANT("printf: long with %S", want, "%s|%S", big, PSTR("ab"));
+}
+
+
+// Batch mode =============================================================================
+
+
+// Feeds `lines` to the check instance in batch mode, and checks that the output has status frame `frame`
+#define CHECK_BATCH(what, lines, frame) do { \
+    capture.len= 0; \
+    cmd_t * prev= cmd_select(&check_cmd); \
+    cmd_set_batch(true); \
+    cmd_addstr(lines); \
+    cmd_outflush(); \
+    cmd_set_batch(false); \
+    cmd_select(prev); \
+    capture.buf[capture.len<(int)sizeof capture.buf ? capture.len : (int)sizeof capture.buf-1]= '\0'; \
+    CHECK( strstr(capture.buf, frame)!=0, what ); \
+  } while(0)
+
+
+// A failing built-in command must give an ERR frame (its status), not OK
+static void check_batch() {
+  cmd_init(&check_cmd, &capture, 0);
+  CHECK_BATCH("batch: ok", "echo line x\n", "#0 OK\n");
+  CHECK_BATCH("batch: not found", "nosuchcommand\n", "#0 ERR 1\n");
+  CHECK_BATCH("batch: help not found", "help nosuchcommand\n", "#0 ERR 1\n");
+  CHECK_BATCH("batch: help too many", "help help help\n", "#0 ERR 3\n");
+  CHECK_BATCH("batch: echo bad subcommand", "echo batch maybe\n", "#0 ERR 3\n");
+  #if CMD_PROF
+    CHECK_BATCH("batch: prof bad argument", "prof xx\n", "#0 ERR 3\n");
+  #endif
+  CHECK_BATCH("batch: frames per command", "help nosuchcommand; echo line x\n", "#0 ERR 1\nx\n#1 OK\n");
+}
+
+
+// Binary mode ============================================================================
+
+
+// The payload of the last frame passed to the binary function, and the number of frames
+uint8_t check_bindata[16];
+int     check_binlen;
+int     check_binframes;
+static void check_binfunc(const uint8_t * data, int len) {
+  check_binlen= len<(int)sizeof check_bindata ? len : (int)sizeof check_bindata;
+  memcpy(check_bindata, data, check_binlen);
+  check_binframes++;
+}
+static void check_binmain(int argc, char * argv[]) {
+  (void)argc; (void)argv;
+  cmd_set_binfunc(check_binfunc);
+}
+
+
+// COBS encodes `len` bytes of `payload` followed by its CRC, and the 0x00 delimiter, into `out`; returns the length
+static int check_cobs(const uint8_t * payload, int len, uint8_t * out) {
+  uint8_t data[16];
+  memcpy(data, payload, len);
+  uint16_t crc= cmd_crc16(payload, len);
+  data[len]= crc & 0xFF; data[len+1]= crc >> 8;
+  int n= 0, code= n++; // Index of the code byte of the current block
+  for( int i=0; i<len+2; i++ ) {
+    if( data[i]==0 ) { out[code]= n-code; code= n++; } else out[n++]= data[i];
+  }
+  out[code]= n-code;
+  out[n++]= 0;
+  return n;
+}
+
+
+// Feeds the line `enable` (`n` chars, it switches to binary mode), a frame with `payload` and the sentinel; checks the frame arrived
+static void check_binline(const char * what, const char * enable, int n, const uint8_t * payload, int len) {
+  uint8_t buf[64];
+  memcpy(buf, enable, n);
+  n+= check_cobs(payload, len, buf+n);
+  n+= check_cobs(payload, 0, buf+n); // The sentinel
+  capture.len= 0;
+  check_binframes= 0;
+  cmd_t * prev= cmd_select(&check_cmd);
+  cmd_geterrorcount();
+  cmd_addbuf((const char *)buf, n);
+  cmd_outflush();
+  CHECK( check_binframes==1 && check_binlen==len && memcmp(check_bindata,payload,len)==0 && cmd_geterrorcount()==0 && cmd_get_binfunc()==0, what );
+  cmd_select(prev);
+}
+#define CHECK_BINLINE(what, enable, payload, len) check_binline(what, enable, sizeof(enable)-1, payload, len)
+
+
+// The line enabling binary mode may end in "\r\n": the '\n' is not a COBS code byte, but 0x0A directly after "\n" is
+static void check_binary() {
+  cmd_init(&check_cmd, &capture, 0);
+  cmd_register(check_binmain, PSTR("chkbin"), PSTR("switches to binary mode (check)"), PSTR(""));
+  static const uint8_t payload[]= { 1, 2, 3, 4, 5, 6, 7, 0, 9 }; 
+  CHECK( cmd_crc16(payload,7)>>8!=0 && (cmd_crc16(payload,7)&0xFF)!=0, "binary: no zero in CRC" ); // So 7 bytes give code byte 0x0A
+  CHECK_BINLINE("binary: after \\n", "chkbin\n", payload, 3);
+  CHECK_BINLINE("binary: after \\r\\n", "chkbin\r\n", payload, 3);
+  CHECK_BINLINE("binary: after \\n, code byte 0x0A", "chkbin\n", payload, 7);
+  CHECK_BINLINE("binary: after \\r\\n, code byte 0x0A", "chkbin\r\n", payload, 7);
+  CHECK_BINLINE("binary: after \\r and 0x00", "chkbin\r\0", payload, 9);
+}
+
+
+// The main program =======================================================================
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.check") );
+
+  cmd_init();
+  cmdecho_register();
+  cmdhelp_register();
+  #if CMD_PROF
+    cmdprof_register();
+  #endif
+  check_parse();
+  check_stats();
+  check_printf();
+  check_batch();
+  check_binary();
+
+  Serial.print(F("check: ")); Serial.print(check_passed); Serial.print(F(" passed, "));
+  Serial.print(check_failed); Serial.println(F(" failed"));
+  exit( check_failed>0 ? 1 : 0 );
+}
+
+
+void loop() {
+}
@@ -0,0 +1,102 @@
+// epoll.ino - A host-only example for cmd: interpreters on stdin and on a pseudo terminal, driven by epoll
+#include "cmd.h"
+#include "HostFd.h"
+
+
+#if !CMD_HOST
+#error This example is for the host build only (see README.md section "Host build")
+#endif
+
+
+// The lat command ========================================================================
+
+
+// The wakeup-to-exec latencies of both instances
+cmd_stats_t lat_serial;
+cmd_stats_t lat_pty;
+
+
+// The handlers for the subcommands (vals as declared in LAT_SUBS)
+void cmdlat_show(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)vals;
+  cmd_stats_print(cmd_get_wakestats(), PSTR("lat"), n==1);
+}
+void cmdlat_reset(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)n; (void)vals;
+  cmd_stats_reset(cmd_get_wakestats());
+  cmd_out.print(F("lat: reset\n"));
+}
+
+
+#define LAT_SUBS(X) \
+  X(      , "[e", "hist", cmdlat_show  ) \
+  X( reset, "",   "",     cmdlat_reset )
+CMD_SUBS(cmdlat_subs, LAT_SUBS)
+
+
+void cmdlat_main(int argc, char * argv[]) {
+  cmd_dispatch(argc, argv, cmdlat_subs, CMD_TABLE_COUNT(cmdlat_subs));
+}
+
+
+const char cmdlat_longhelp[] PROGMEM =
+  "SYNTAX: lat [hist]\n"
+  "- shows the latency (us) from wakeup (input ready) to execution of the lines of this terminal\n"
+  "- with hist also the histogram\n"
+  "SYNTAX: lat reset\n"
+  "- clears the latency statistics\n"
+;
+
+
+// The main program =======================================================================
+
+
+cmd_t        cmd_pty;
+HostFdStream pty_stream;
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.epoll") );
+
+  cmd_init();
+  cmdecho_register();  // Use the built-in echo command
+  cmdhelp_register();  // Use the built-in help command
+  cmd_register(cmdlat_main, PSTR("lat"), PSTR("shows wakeup-to-exec latency"), cmdlat_longhelp);
+
+  // The default instance reads stdin (fd 0) and writes Serial (stdout)
+  cmd_stats_init(&lat_serial, 0, 4); // Bins of 16 us
+  cmd_set_wakestats(cmd_current(), &lat_serial);
+  host_add(cmd_current(), 0);
+
+  // A second instance on a pseudo terminal
+  char name[64];
+  int fd= host_openpty(name, sizeof name);
+  if( fd>=0 ) {
+    pty_stream.setfd(fd);
+    cmd_init(&cmd_pty, &pty_stream, 0);
+    cmd_stats_init(&lat_pty, 0, 4);
+    cmd_set_wakestats(&cmd_pty, &lat_pty);
+    host_add(&cmd_pty, fd);
+    cmd_t * prev= cmd_select(&cmd_pty);
+    cmd_prompt();
+    cmd_select(prev);
+    Serial.print( F("Connect a terminal to ") ); Serial.println( name );
+  }
+
+  Serial.println( );
+  Serial.println( F("Type 'help' for help") );
+  Serial.println( F("Try 'echo wait 1000' (the interpreter sleeps, no busy polling) and 'lat'") );
+  cmd_prompt();
+}
+
+
+void loop() {
+  // Sleeps until input (or a task step); stdin closing ends the demo (the pty never hangs up, its slave is kept open)
+  if( host_open(0) ) { host_step(); return; }
+  // Once stdin is closed host_step() no longer steps its instance: finish its task (and the input read before) first
+  int ms= cmd_waitms(cmd_current());
+  if( ms<0 ) { fflush(stdout); exit(0); }
+  delay(ms);
+  cmd_feed(cmd_current(), 0, 0);
+}
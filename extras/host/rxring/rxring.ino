@@ -0,0 +1,157 @@
+// rxring.ino - A host-only example for cmd: a thread fills a receive ring, loop() executes the lines from it
+#include "cmd.h"
+#include <thread>
+
+
+#if !CMD_HOST
+#error This example is for the host build only (see README.md section "Host build")
+#endif
+
+
+// A stream that drops its output (the instance on the ring prints a prompt per line)
+class NullStream : public Stream {
+  public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t write(uint8_t ch) { (void)ch; return 1; }
+    virtual size_t write(const uint8_t * buf, size_t size) { (void)buf; return size; }
+    virtual int availableForWrite() { return 0x7FFF; }
+    using Print::write;
+};
+
+
+// The receive ring, and the instance that consumes it
+NullStream nullstream;
+cmd_rx_t   rx1;
+cmd_t      cmd_rx1;
+
+
+// The rx command =========================================================================
+
+
+// The producer thread puts `lines` lines "seq <n> <check>" in the ring; the seq command checks them in loop()
+std::thread rxload_thread;
+bool        rxload_running; // A load is running (main thread only)
+bool        rxload_done;    // The producer has put all lines (atomic)
+uint32_t    rxload_full;    // Number of times the producer found the ring full (atomic)
+int         rxload_lines;   // Number of lines put by the producer
+int         rxload_next;    // Number of the next expected line (consumer only)
+int         rxload_ok;      // Number of lines in order and intact (consumer only)
+int         rxload_bad;     // Number of lines out of order or damaged (consumer only)
+uint32_t    rxload_start;   // Time (micros) the thread was started
+
+
+// The check value of line n (so that damaged lines are detected)
+static int rxload_check(int n) {
+  return (int)( (n*7919L) % 10007 );
+}
+
+
+// Puts the lines in the ring; odd lines byte by byte (as an ISR), even lines in chunks (as a DMA callback).
+// The producer waits when the ring is full (it checks the room first), so nothing is dropped.
+static void rxload_producer(int lines) {
+  char line[32];
+  for( int n=0; n<lines; n++ ) {
+    int len= snprintf(line, sizeof line, "seq %d %d\n", n, rxload_check(n));
+    int i= 0;
+    while( i<len ) {
+      int room= cmd_rx_room(&rx1);
+      if( room==0 ) { __atomic_add_fetch(&rxload_full, 1, __ATOMIC_RELAXED); std::this_thread::yield(); continue; }
+      if( n%2 ) {
+        if( cmd_rx_put(&rx1, line[i]) ) i++;
+      } else {
+        int size= len-i<room ? len-i : room;
+        i+= cmd_rx_putbuf(&rx1, (const uint8_t *)&line[i], size);
+      }
+    }
+  }
+  __atomic_store_n(&rxload_done, true, __ATOMIC_RELEASE);
+}
+
+
+// The task that waits until the producer is done and the ring is empty (loop() keeps polling the ring meanwhile)
+static bool cmdrx_task(uint32_t * state, bool cancel) {
+  (void)state;
+  // The thread can not be cancelled; Ctrl-C only stops waiting for the results (and waits for the thread)
+  if( !cancel && !(__atomic_load_n(&rxload_done, __ATOMIC_ACQUIRE) && cmd_rx_room(&rx1)==CMD_RXSIZE) ) return true;
+  rxload_thread.join();
+  uint32_t us= micros()-rxload_start;
+  int missing= rxload_lines-rxload_ok-rxload_bad;
+  cmd_out.print(F("rx: ")); cmd_out.print(rxload_ok); cmd_out.print(F(" ok, "));
+  cmd_out.print(rxload_bad); cmd_out.print(F(" bad, ")); cmd_out.print(missing); cmd_out.print(F(" missing, "));
+  cmd_out.print(cmd_rx_overruns(&rx1)); cmd_out.print(F(" overruns, ring full "));
+  cmd_out.print(rxload_full); cmd_out.print(F(" times, "));
+  cmd_out.print(us); cmd_out.print(F(" us\n"));
+  if( rxload_bad>0 || missing>0 ) cmd_set_status(CMD_ERR_FAIL);
+  rxload_running= false;
+  return false;
+}
+
+
+// The handler for the "rx" command
+void cmdrx_main(int argc, char * argv[]) {
+  int lines= 1000;
+  if( argc>2 || (argc==2 && (!cmd_parse_dec(argv[1],&lines) || lines<1)) ) { cmd_out.print(F("ERROR: rx: expected number of lines\n")); cmd_set_status(CMD_ERR_ARGS); return; }
+  rxload_lines= lines; rxload_next= 0; rxload_ok= 0; rxload_bad= 0; rxload_full= 0; rxload_done= false;
+  rxload_running= true;
+  rxload_start= micros();
+  rxload_thread= std::thread(rxload_producer, lines);
+  cmd_start_task(cmdrx_task, 0);
+}
+
+
+const char cmdrx_longhelp[] PROGMEM =
+  "SYNTAX: rx [<lines>]\n"
+  "- starts a thread that puts <lines> lines (default 1000) in a receive ring\n"
+  "- loop() executes them on a second instance; each line is a seq command\n"
+  "- shows the number of lines in order, out of order or damaged, and missing\n"
+;
+
+
+// The handler for the "seq" command (the lines from the ring): checks the number and the check value
+void cmdseq_main(int argc, char * argv[]) {
+  int n, check;
+  bool ok= argc==3 && cmd_parse_dec(argv[1],&n) && cmd_parse_dec(argv[2],&check) && n==rxload_next && check==rxload_check(n);
+  if( ok ) rxload_ok++; else rxload_bad++;
+  rxload_next= ok ? n+1 : rxload_next+1;
+}
+
+
+const char cmdseq_longhelp[] PROGMEM =
+  "SYNTAX: seq <n> <check>\n"
+  "- checks line <n> of the rx load (it should be the next one, with the right check value)\n"
+;
+
+
+// The main program =======================================================================
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.rxring") );
+
+  cmd_init();
+  cmdecho_register();  // Use the built-in echo command
+  cmdhelp_register();  // Use the built-in help command
+  cmd_register(cmdrx_main, PSTR("rx"), PSTR("fills a receive ring from a thread"), cmdrx_longhelp);
+  cmd_register(cmdseq_main, PSTR("seq"), PSTR("checks a line of the rx load"), cmdseq_longhelp);
+  cmd_init(&cmd_rx1, &nullstream, 0);
+  cmd_rx_init(&rx1);
+
+  Serial.println( );
+  Serial.println( F("Type 'help' for help") );
+  Serial.println( F("Try 'rx' and 'rx 10000'") );
+  cmd_prompt();
+}
+
+
+void loop() {
+  cmd_pollserial();
+  cmd_rx_poll(&cmd_rx1, &rx1);
+  // Closing stdin ends the demo, but not before a running load has finished
+  while( Serial.eof() && rxload_running ) {
+    cmd_pollserial();
+    cmd_rx_poll(&cmd_rx1, &rx1);
+  }
+}
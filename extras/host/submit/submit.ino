@@ -0,0 +1,131 @@
+// submit.ino - A host-only example for cmd: threads submit lines to the interpreter, with a submission queue
+#include "cmd.h"
+#include <thread>
+
+
+#if !CMD_HOST
+#error This example is for the host build only (see README.md section "Host build")
+#endif
+
+
+// The submission queue, and its instance (with small buffers)
+cmd_subq_t subq;
+cmd_t      cmd_subq;
+CMD_CONFIG(subq_cfg, 64, 8, 1, 64)
+
+
+// The load command =======================================================================
+
+
+// The producers: each thread submits `lines` lines, and checks the output and status of each
+#define LOAD_MAXTHREADS 8
+std::thread load_threads[LOAD_MAXTHREADS];
+int         load_count;    // Number of threads started
+uint32_t    load_ok;       // Number of lines with the expected output and status (atomic)
+uint32_t    load_bad;      // Number of lines with other output or status (atomic)
+uint32_t    load_full;     // Number of times the queue was full (atomic)
+uint32_t    load_start;    // Time (micros) the threads were started
+
+
+// Line n of thread t: mostly an echo, every 50th line a command that does not exist, every 100th a task
+static void load_producer(int t, int lines) {
+  char line[64];
+  char out[64];
+  char expect[64];
+  cmd_submit_t sub;
+  for( int n=0; n<lines; n++ ) {
+    int status= CMD_OK;
+    if( n%100==99 ) {
+      snprintf(line, sizeof line, "echo wait 1"); snprintf(expect, sizeof expect, "echo: wait: 1\n");
+    } else if( n%50==49 ) {
+      snprintf(line, sizeof line, "nope%d", t); snprintf(expect, sizeof expect, "ERROR: command 'nope%d' not found (try help)\n", t);
+      status= CMD_ERR_NOTFOUND;
+    } else {
+      snprintf(line, sizeof line, "echo line %d.%d", t, n); snprintf(expect, sizeof expect, "%d.%d\n", t, n);
+    }
+    sub.line= line;
+    sub.out= out;
+    sub.outsize= sizeof out;
+    while( !cmd_submit(&subq, &sub) ) { __atomic_add_fetch(&load_full, 1, __ATOMIC_RELAXED); std::this_thread::yield(); }
+    while( !cmd_submit_done(&sub) ) std::this_thread::yield();
+    bool ok= sub.status==status && strcmp(out, expect)==0;
+    __atomic_add_fetch(ok ? &load_ok : &load_bad, 1, __ATOMIC_RELAXED);
+  }
+}
+
+
+// The task that waits until the producers are done (so that the interpreter keeps polling the queue meanwhile)
+static bool cmdload_task(uint32_t * state, bool cancel) {
+  // Threads can not be cancelled; Ctrl-C only stops waiting for the results (and waits for the threads)
+  if( !cancel && __atomic_load_n(&load_ok, __ATOMIC_RELAXED)+__atomic_load_n(&load_bad, __ATOMIC_RELAXED)<*state ) return true;
+  uint32_t us= micros()-load_start;
+  for( int t=0; t<load_count; t++ ) load_threads[t].join();
+  cmd_out.print(F("load: ")); cmd_out.print(load_ok); cmd_out.print(F(" ok, "));
+  cmd_out.print(load_bad); cmd_out.print(F(" bad, queue full "));
+  cmd_out.print(load_full); cmd_out.print(F(" times, "));
+  cmd_out.print(us); cmd_out.print(F(" us\n"));
+  load_count= 0;
+  return false;
+}
+
+
+// The handler for the subcommands (vals as declared in LOAD_SUBS)
+void cmdload_run(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv;
+  int threads= n>0 ? vals[0].dec : 4;
+  int lines= n>1 ? vals[1].dec : 1000;
+  if( threads<1 || threads>LOAD_MAXTHREADS || lines<1 ) { cmd_out.print(F("ERROR: load: 1..8 threads, 1 or more lines\n")); cmd_set_status(CMD_ERR_ARGS); return; }
+  load_ok= 0; load_bad= 0; load_full= 0;
+  load_start= micros();
+  for( load_count=0; load_count<threads; load_count++ ) load_threads[load_count]= std::thread(load_producer, load_count, lines);
+  cmd_start_task(cmdload_task, threads*lines);
+}
+
+
+#define LOAD_SUBS(X) \
+  X(      , "[dd", "", cmdload_run )
+CMD_SUBS(cmdload_subs, LOAD_SUBS)
+
+
+void cmdload_main(int argc, char * argv[]) {
+  cmd_dispatch(argc, argv, cmdload_subs, CMD_TABLE_COUNT(cmdload_subs));
+}
+
+
+const char cmdload_longhelp[] PROGMEM =
+  "SYNTAX: load [<threads> [<lines>]]\n"
+  "- starts <threads> threads (default 4) that each submit <lines> lines (default 1000) to the submission queue\n"
+  "- each thread checks the captured output and status of its lines\n"
+  "- shows the number of good and bad lines, how often the queue was full, and the time\n"
+;
+
+
+// The main program =======================================================================
+
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println( F("Welcome to the demo cmd.submit") );
+
+  cmd_init();
+  cmdecho_register();  // Use the built-in echo command
+  cmdhelp_register();  // Use the built-in help command
+  cmd_register(cmdload_main, PSTR("load"), PSTR("submits lines from threads"), cmdload_longhelp);
+  cmd_subq_init(&subq, &cmd_subq, &subq_cfg);
+
+  Serial.println( );
+  Serial.println( F("Type 'help' for help") );
+  Serial.println( F("Try 'load' and 'load 8 10000'") );
+  cmd_prompt();
+}
+
+
+void loop() {
+  cmd_pollserial();
+  cmd_subq_poll(&subq);
+  // Closing stdin ends the demo, but not before a running load has finished
+  while( Serial.eof() && load_count>0 ) {
+    cmd_pollserial();
+    cmd_subq_poll(&subq);
+  }
+}
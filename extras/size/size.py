@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# size.py - reports the flash and RAM cost of the optional features of cmd (see "Features" in cmd.h)
+# From https://github.com/maarten-pennings/cmd
+#
+# Usage: python3 size.py [-e EXAMPLE]... [-f FEATURE]... [--cxx CXX] [--size SIZE] [--flags FLAGS] [--baseline REF]
+#
+# Builds the examples (default basic, full and streaming) with the host build (see README.md section
+# "Host build"): once with the default configuration, once with each feature switched off (-DFEATURE=0),
+# and once with all of them off. The builds use -Os and let the linker drop unused functions, just like
+# the Arduino builds. It runs SIZE on each image and tabulates the flash (text+data) and RAM (data+bss)
+# of the default build, and how much each feature costs (what switching it off saves).
+# An example that needs a feature does not build without it; its cell then shows "n/a".
+# With --baseline REF (a git ref, e.g. HEAD~1 or a tag) it also builds the library and examples of REF (with 
+# the host shim of the working tree) in the same configurations, prints how much each image grew, and exits 
+# with status 1 when any image grew. Use it before a commit, so that a size regression is noticed.
+# The absolute numbers include the host shim and the C++ runtime, the differences are the cost of cmd.
+# The numbers of a host build are not those of an AVR build (wider pointers and ints, other code
+# generation), but the ranking of the features is similar. Run it from any directory; it builds in a
+# temporary directory.
+
+
+import argparse
+import concurrent.futures
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+
+ROOT= os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+FEATURES= [ "CMD_ECHO_FAULTS", "CMD_ECHO_WAIT", "CMD_ECHO_ENABLE", "CMD_PRINTF_P", "CMD_HEX32",
+            "CMD_STREAMPROMPT", "CMD_HELP_CHUNKS", "CMD_PROF", "CMD_TRACE", "CMD_SUBMIT",
+            "CMD_BINARY", "CMD_FLOW", "CMD_BATCH", "CMD_STATS" ]
+EXAMPLES= [ "basic", "full", "streaming" ]
+
+
+# Runs `cmd` (a list), exits with its output when it fails (returns None instead when not `check`)
+def run(cmd, check=True) :
+  p= subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+  if p.returncode!=0 :
+    if not check : return None
+    sys.exit("size: failed: " + " ".join(cmd) + "\n" + p.stdout)
+  return p.stdout
+
+
+# Compiles the library in `root` once for configuration `defs` (a list of -D flags) and links each example; 
+# returns {example:(flash,ram)}, with None for an example that does not build in this configuration (or does not exist).
+# In the default configuration (no `defs`) all examples must build.
+def build(args, tmp, root, name, defs, examples) :
+  cxx= [args.cxx, "-std=gnu++11", "-Os", "-ffunction-sections", "-fdata-sections",
+        "-I"+os.path.join(ROOT,"extras","host"), "-I"+os.path.join(root,"src"), "-include", "Arduino.h"] + args.flags.split() + defs
+  objs= []
+  for src in sorted(glob.glob(os.path.join(root,"src","*.cpp"))) + [os.path.join(ROOT,"extras","host","Arduino.cpp")] :
+    obj= os.path.join(tmp, name+"-"+os.path.basename(src)+".o")
+    run(cxx + ["-c", src, "-o", obj])
+    objs.append(obj)
+  sizes= {}
+  for ex in examples :
+    img= os.path.join(tmp, name+"-"+ex)
+    ino= os.path.join(root,"examples",ex,ex+".ino")
+    if not os.path.exists(ino) and root!=ROOT :
+      sizes[ex]= None
+      continue
+    if run(cxx + ["-x", "c++", ino, "-x", "none"] + objs + ["-Wl,--gc-sections", "-o", img, "-lpthread"], check=len(defs)==0) is None :
+      sizes[ex]= None
+      continue
+    # Berkeley format: text data bss dec hex filename
+    text,data,bss= [int(v) for v in run([args.size, img]).splitlines()[1].split()[0:3]]
+    sizes[ex]= (text+data, data+bss)
+  return sizes
+
+
+# Formats a cell of the table: `pair` is (flash,ram) or None
+def cell(pair, fmt=" | %7d %8d") :
+  return " | %16s" % "n/a" if pair is None else fmt % pair
+
+
+def main() :
+  parser= argparse.ArgumentParser(description="Reports the flash and RAM cost of the optional features of cmd")
+  parser.add_argument("-e", "--example", action="append", help="example to build (default: basic, full and streaming); may be repeated")
+  parser.add_argument("-f", "--feature", action="append", help="feature to switch off (default: all in cmd.h); may be repeated")
+  parser.add_argument("--cxx", default="g++", help="compiler (default 'g++')")
+  parser.add_argument("--size", default="size", help="size tool (default 'size')")
+  parser.add_argument("--flags", default="", help="extra compiler flags, e.g. '-m32'")
+  parser.add_argument("--baseline", metavar="REF", help="git ref to compare with (e.g. HEAD~1); exits with 1 when an image grew")
+  args= parser.parse_args()
+  examples= args.example or EXAMPLES
+  features= args.feature or FEATURES
+
+  # The configurations: default, each feature off, all off
+  configs= [ ("default",[]) ] + [ (f,["-D"+f+"=0"]) for f in features ] + [ ("all off",["-D"+f+"=0" for f in features]) ]
+  with tempfile.TemporaryDirectory() as tmp :
+    # The sources of the baseline, from git
+    if args.baseline :
+      baseroot= os.path.join(tmp, "baseline")
+      os.mkdir(baseroot)
+      tar= os.path.join(tmp, "baseline.tar")
+      run(["git", "-C", ROOT, "archive", "-o", tar, args.baseline, "src", "examples"])
+      run(["tar", "-x", "-f", tar, "-C", baseroot])
+    with concurrent.futures.ThreadPoolExecutor(os.cpu_count()) as pool :
+      jobs= [ pool.submit(build, args, tmp, ROOT, "c%d"%i, defs, examples) for i,(name,defs) in enumerate(configs) ]
+      if args.baseline :
+        basejobs= [ pool.submit(build, args, tmp, baseroot, "b%d"%i, defs, examples) for i,(name,defs) in enumerate(configs) ]
+      results= [ job.result() for job in jobs ]
+      if args.baseline :
+        baseresults= [ job.result() for job in basejobs ]
+
+  # The table: absolute sizes for the default, savings for the others
+  base= results[0]
+  head= "%-18s" % "feature" + "".join( " | %16s" % ex for ex in examples )
+  print(head)
+  print("%-18s" % "" + "".join( " | %7s %8s" % ("flash","ram") for ex in examples ))
+  print("-"*len(head))
+  for (name,defs),sizes in zip(configs,results) :
+    if name=="default" :
+      cols= [ cell(base[ex]) for ex in examples ]
+    else :
+      cols= [ cell(None if sizes[ex] is None else (base[ex][0]-sizes[ex][0], base[ex][1]-sizes[ex][1])) for ex in examples ]
+    print("%-18s" % name + "".join(cols))
+  print("(default: bytes of the image; others: bytes saved by setting the feature to 0)")
+
+  # The comparison with the baseline: growth of each image
+  if args.baseline :
+    grown= []
+    print()
+    print("%-18s" % ("vs "+args.baseline) + "".join( " | %16s" % ex for ex in examples ))
+    print("-"*len(head))
+    for (name,defs),sizes,basesizes in zip(configs,results,baseresults) :
+      cols= []
+      for ex in examples :
+        if sizes[ex] is None or basesizes[ex] is None :
+          cols.append(cell(None))
+          continue
+        growth= (sizes[ex][0]-basesizes[ex][0], sizes[ex][1]-basesizes[ex][1])
+        if growth[0]>0 or growth[1]>0 : grown.append(name+"/"+ex)
+        cols.append(cell(growth, " | %+7d %+8d"))
+      print("%-18s" % name + "".join(cols))
+    print("(bytes grown since %s)" % args.baseline)
+    if grown :
+      sys.exit("size: grew: " + ", ".join(grown))
+
+
+if __name__=="__main__" :
+  main()
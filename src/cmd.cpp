@@ -3,110 +3,829 @@
 //#include <avr/pgmspace.h> // This library assumes most strings (command help texts) are in PROGMEM (flash, not RAM)
 
 #include <Arduino.h>
+#include <stdio.h> // fdev_setup_stream (AVR)
+#include <limits.h> // INT_MAX
+#include <math.h> // sqrt
 #include "cmd.h"
+#if CMD_SCRATCH_STACK
+#include <alloca.h>
+#endif
+
+
+// The instances ===================================================================
+
+
+// The default instance (on Serial), its buffers, and the current instance
+static cmd_t   cmd_serial;
+static char    cmd_serial_buf[CMD_BUFSIZE]; 
+static char    cmd_serial_prompt[CMD_PROMPT_SIZE];
+#if CMD_ARGV_SCRATCH
+  #define cmd_serial_argv 0 // Built in scratch when a line executes
+#else
+  static char * cmd_serial_argv[CMD_MAXARGS];
+#endif
+#if CMD_OUTSIZE>0
+  static uint8_t cmd_serial_outbuf[CMD_OUTSIZE];
+#else
+  #define cmd_serial_outbuf 0 // No output queue
+#endif
+static cmd_t * cmd_cur= &cmd_serial;
+// The modes of the current instance that can be left out (see CMD_BINARY and CMD_BATCH)
+#if CMD_BINARY
+  #define CMD_ISBINARY() (cmd_cur->binfunc!=0)
+#else
+  #define CMD_ISBINARY() false
+#endif
+#if CMD_BATCH
+  #define CMD_ISBATCH() (cmd_cur->batch)
+#else
+  #define CMD_ISBATCH() false
+#endif
+
+
+// Makes `cmd` the current instance; returns the previous current instance
+cmd_t * cmd_select(cmd_t * cmd) {
+  cmd_t * prev= cmd_cur;
+  cmd_cur= cmd;
+  return prev;
+}
+
+
+// Returns the current instance
+cmd_t * cmd_current(void) {
+  return cmd_cur;
+}
+
+
+// The stream of the current instance (Serial when the default instance is not yet initialized)
+static Stream * cmd_stream(void) {
+  return cmd_cur->stream ? cmd_cur->stream : &Serial;
+}
+
+
+// The scratch arena ===============================================================
+
+
+// The arena (of void pointers, so that it is aligned), the fill level and the peak fill level
+#define CMD_SCRATCH_BYTES ( (CMD_SCRATCH_SIZE+sizeof(void *)-1)/sizeof(void *)*sizeof(void *) )
+#if CMD_SCRATCH_STACK
+// The arena is on the stack of the outermost call into the interpreter (0 when there is none); it is shared by the instances
+static void * cmd_scratch= 0;
+// Makes the arena for the function that uses these; it is taken from its stack (alloca) when no arena exists yet.
+// The arena goes when that function returns: CMD_SCRATCH_CLOSE() must precede each of its returns.
+#define CMD_SCRATCH_OPEN() bool cmd_scratch_opened= cmd_scratch==0; if( cmd_scratch_opened ) cmd_scratch= alloca(CMD_SCRATCH_BYTES)
+#define CMD_SCRATCH_CLOSE() do { if( cmd_scratch_opened ) { cmd_scratch= 0; cmd_scratch_top= 0; } } while(0)
+#else
+// The arena is static; it is shared by the instances
+static void * cmd_scratch[CMD_SCRATCH_BYTES/sizeof(void *)];
+#define CMD_SCRATCH_OPEN()
+#define CMD_SCRATCH_CLOSE()
+#endif
+static int    cmd_scratch_top= 0;
+static int    cmd_scratch_peak= 0;
+
+
+// Allocates `size` bytes from the scratch arena; returns 0 when there is not enough space.
+void * cmd_scratch_alloc( int size ) {
+  size= (size+sizeof(void *)-1) & ~(sizeof(void *)-1); // Keep the next allocation aligned
+#if CMD_SCRATCH_STACK
+  if( cmd_scratch==0 ) return 0; // Not called from within the interpreter
+#endif
+  if( size>(int)CMD_SCRATCH_BYTES-cmd_scratch_top ) return 0;
+  void * p= (uint8_t *)cmd_scratch + cmd_scratch_top;
+  cmd_scratch_top+= size;
+  if( cmd_scratch_top>cmd_scratch_peak ) cmd_scratch_peak= cmd_scratch_top;
+  return p;
+}
+
 
+// Frees `p` and all that was allocated after it.
+void cmd_scratch_free( void * p ) {
+  if( p!=0 ) cmd_scratch_top= (uint8_t *)p - (uint8_t *)cmd_scratch;
+}
+
+
+// Returns the number of free bytes in the scratch arena.
+int cmd_scratch_avail( void ) {
+#if CMD_SCRATCH_STACK
+  if( cmd_scratch==0 ) return 0;
+#endif
+  return CMD_SCRATCH_BYTES-cmd_scratch_top;
+}
+
+
+// Returns the highest number of scratch bytes in use (and optionally clears it).
+int cmd_get_scratchpeak( bool clear ) {
+  int peak= cmd_scratch_peak;
+  if( clear ) cmd_scratch_peak= cmd_scratch_top;
+  return peak;
+}
+
+
+// The output queue ================================================================
+
+
+// Sends (at most) `max` of the oldest queued bytes to the stream (in at most two writes, since the queue wraps)
+static void cmd_outsend( int max ) {
+  while( max>0 && cmd_cur->outlen>0 ) {
+    int size= cmd_cur->outsize-cmd_cur->outhead; // Contiguous part
+    if( size>cmd_cur->outlen ) size= cmd_cur->outlen;
+    if( size>max ) size= max;
+    cmd_stream()->write(&cmd_cur->outbuf[cmd_cur->outhead], size);
+    cmd_cur->outhead= (cmd_cur->outhead+size) % cmd_cur->outsize;
+    cmd_cur->outlen-= size;
+    max-= size;
+  }
+}
 
-// A struct to store a command descriptor
-typedef struct cmd_desc_s { 
-  cmd_func_t   main; 
-  const char * name; 
-  const char * shorthelp; 
-  const char * longhelp; 
-} cmd_desc_t;
 
+// Returns how many bytes the stream accepts without blocking.
+// A stream that never reported space (e.g. a network client) probably does not implement availableForWrite(); it gets all.
+static int cmd_outroom( void ) {
+  int room= cmd_stream()->availableForWrite();
+  if( room>0 ) cmd_cur->outaw= true; else if( !cmd_cur->outaw ) room= cmd_cur->outsize;
+  return room;
+}
+
+
+// Writes queued output to the stream as far as possible without blocking. Returns the number of bytes still queued.
+int cmd_outdrain( void ) {
+  if( cmd_cur->outlen>0 ) cmd_outsend( cmd_outroom() );
+  return cmd_cur->outlen;
+}
+
+
+// Writes all queued output to the stream (blocking)
+void cmd_outflush( void ) {
+  if( cmd_cur->outlen==0 ) return;
+  if( cmd_outroom()<cmd_cur->outlen ) cmd_cur->outstats.stalls++;
+  cmd_outsend( cmd_cur->outlen );
+}
+
+
+// The output of the current instance
+cmd_out_t cmd_out;
+
+
+// Appends `size` bytes to the output queue (of the current instance). When the queue is full, it waits (or drops), see CMD_OUTBLOCK.
+size_t cmd_out_t::write(const uint8_t * buf, size_t size) {
+  cmd_cur->outstats.bytes+= size;
+  if( cmd_cur->outsize==0 ) return cmd_stream()->write(buf, size); // Not initialized (no queue yet)
+  size_t done= 0;
+  while( done<size ) {
+    if( cmd_cur->outlen==cmd_cur->outsize && cmd_outdrain()==cmd_cur->outsize ) {
+      #if CMD_OUTBLOCK
+        cmd_outflush(); 
+      #else
+        cmd_cur->outstats.drops+= size-done;
+        return done;
+      #endif
+    }
+    // Copy to the free contiguous part of the queue
+    int tail= (cmd_cur->outhead+cmd_cur->outlen) % cmd_cur->outsize;
+    int room= (tail>=cmd_cur->outhead ? cmd_cur->outsize : cmd_cur->outhead) - tail;
+    if( room>cmd_cur->outsize-cmd_cur->outlen ) room= cmd_cur->outsize-cmd_cur->outlen;
+    int n= size-done < (size_t)room ? size-done : room;
+    memcpy(&cmd_cur->outbuf[tail], buf+done, n);
+    cmd_cur->outlen+= n;
+    done+= n;
+  }
+  return done;
+}
+
+
+size_t cmd_out_t::write(uint8_t ch) {
+  return write(&ch,1);
+}
+
+
+// Called before a command (or streaming function) executes, see CMD_OUTFLUSH
+static void cmd_outsync( void ) {
+  #if CMD_OUTFLUSH
+    cmd_outflush();
+  #endif
+}
+
+
+// Returns the output counters; when `clear` is true, the counters are cleared after being returned.
+cmd_outstats_t cmd_get_outstats( bool clear ) {
+  cmd_outstats_t stats= cmd_cur->outstats;
+  if( clear ) memset(&cmd_cur->outstats, 0, sizeof cmd_cur->outstats);
+  return stats;
+}
+
+
+// Flow control ====================================================================
+
+
+#if CMD_FLOW
+// Sets the flow control `mode` of the current instance; `pin` is the RTS pin (only for CMD_FLOW_RTS).
+void cmd_set_flow( int mode, int pin ) {
+  cmd_cur->flow= mode;
+  cmd_cur->flowpin= pin;
+  cmd_cur->flowstopped= false;
+  if( mode==CMD_FLOW_RTS ) { pinMode(pin, OUTPUT); digitalWrite(pin, LOW); } // LOW (asserted) means "send"
+}
+
+
+// Returns the flow control mode of the current instance.
+int cmd_get_flow( void ) {
+  return cmd_cur->flow;
+}
+
+
+// Sets the high-water and low-water mark of the current instance.
+void cmd_set_flowmarks( int high, int low ) {
+  cmd_cur->flowhigh= high;
+  cmd_cur->flowlow= low;
+}
+
+
+// Returns the input counters of the current instance (and optionally clears them).
+cmd_flowstats_t cmd_get_flowstats( bool clear ) {
+  cmd_flowstats_t stats= cmd_cur->flowstats;
+  if( clear ) memset(&cmd_cur->flowstats, 0, sizeof cmd_cur->flowstats);
+  return stats;
+}
+
+
+// Stops the sender (when flow control is on). The XOFF bypasses the output queue.
+static void cmd_flowstop( void ) {
+  if( cmd_cur->flow==CMD_FLOW_OFF || cmd_cur->flowstopped ) return;
+  if( cmd_cur->flow==CMD_FLOW_XONXOFF ) cmd_stream()->write((uint8_t)CMD_XOFF); else digitalWrite(cmd_cur->flowpin, HIGH);
+  cmd_cur->flowstopped= true;
+  cmd_cur->flowstats.stops++;
+}
+
+
+// Resumes the sender (when it was stopped)
+static void cmd_flowgo( void ) {
+  if( !cmd_cur->flowstopped ) return;
+  if( cmd_cur->flow==CMD_FLOW_XONXOFF ) cmd_stream()->write((uint8_t)CMD_XON); else digitalWrite(cmd_cur->flowpin, LOW);
+  cmd_cur->flowstopped= false;
+}
+
+
+// Called by the poll functions with the number of bytes `pending` in the receive buffer: records the peak, 
+// and stops the sender at the high-water mark. Returns `pending`.
+static int cmd_flowlevel( int pending ) {
+  if( pending>cmd_cur->flowstats.rxpeak ) cmd_cur->flowstats.rxpeak= pending;
+  if( pending>=cmd_cur->flowhigh ) cmd_flowstop();
+  return pending;
+}
+
+
+// Called by the poll functions with the number of bytes `pending` when they are done: resumes the sender at the low-water mark.
+static void cmd_flowdrained( int pending ) {
+  if( pending<=cmd_cur->flowlow ) cmd_flowgo();
+}
+#else
+// Without flow control, the poll functions only need the number of pending bytes
+static int cmd_flowlevel( int pending ) { return pending; }
+static void cmd_flowdrained( int pending ) { (void)pending; }
+#endif
+
+
+// Batch mode ======================================================================
+
+
+#if CMD_BATCH
+// Switches batch mode of the current instance on or off; switching on restarts the sequence numbers.
+void cmd_set_batch( bool on ) {
+  cmd_cur->batch= on;
+  if( on ) cmd_cur->seq= 0;
+}
+
+
+// Returns true iff the current instance is in batch mode.
+bool cmd_get_batch( void ) {
+  return cmd_cur->batch;
+}
+#endif
+
+
+// Switches splitting of command lines at ';' of the current instance on or off (it applies to the lines entered next).
+void cmd_set_split( bool on ) {
+  cmd_cur->nosplit= !on;
+}
+
+
+// Returns true iff the current instance splits command lines at ';'.
+bool cmd_get_split( void ) {
+  return !cmd_cur->nosplit;
+}
+
+
+// Sets the status of the executing command (CMD_OK, one of CMD_ERR_XXX, or an application code); see cmd_set_batch().
+void cmd_set_status( int code ) {
+  cmd_cur->status= code;
+}
 
-// All command descriptors
+
+// Returns true iff typed chars are to be echoed (never in batch mode, nor for submitted lines)
+static bool cmd_echoing( void ) {
+  return cmd_cur->echo && !CMD_ISBATCH() && !cmd_cur->captured;
+}
+
+
+// The command table ===============================================================
+
+
+// All command descriptors registered at runtime (in RAM)
 static int cmd_descs_count= 0;
 static cmd_desc_t cmd_descs[CMD_REGISTRATION_SLOTS];
 
 
+// The command descriptors declared at compile time (in PROGMEM, see CMD_TABLE)
+static const cmd_desc_t * cmd_table= 0;
+static int cmd_table_count= 0;
+
+
+// Steps on every registration; a lookup in progress (see cmd_tok_narrow) is redone when it changed
+static uint8_t cmd_descs_gen= 0;
+
+
+// Makes the PROGMEM `table` of `count` descriptors (sorted on name) the compile-time command set.
+void cmd_register_table(/*PROGMEM*/const cmd_desc_t * table, int count) {
+  cmd_table= table;
+  cmd_table_count= count;
+  cmd_descs_gen++;
+}
+
+
+// Returns the name of descriptor `ix`: the flash table has indices 0..cmd_table_count-1, cmd_descs[] the indices after that
+static const char * cmd_desc_name(int ix) {
+  if( ix<cmd_table_count ) return (const char *)pgm_read_ptr(&cmd_table[ix].name);
+  return cmd_descs[ix-cmd_table_count].name;
+}
+
+
+// Copies descriptor `ix` (see cmd_desc_name) to RAM
+static void cmd_desc_get(int ix, cmd_desc_t * d) {
+  if( ix<cmd_table_count ) memcpy_P(d, &cmd_table[ix], sizeof *d); else *d= cmd_descs[ix-cmd_table_count];
+}
+
+
+// Compares two strings, both in PROGMEM (like strcmp)
+static int cmd_strcmp_PP(/*PROGMEM*/const char *s1, /*PROGMEM*/const char *s2) {
+  while( 1 ) {
+    byte b1= pgm_read_byte(s1);
+    byte b2= pgm_read_byte(s2);
+    if( b1!=b2 ) return b1<b2 ? -1 : +1;
+    if( b1=='\0' ) return 0;
+    s1++;
+    s2++;
+  }
+}
+
+
 // The registration function for command descriptors (all strings in PROGMEM!)
-// Returns number of remaining free slots (or -1 and a Serial print if registration failed)
+// Returns number of remaining free slots (or -1 and an error print if registration failed)
 int cmd_register(cmd_func_t main, const char * name, const char * shorthelp, const char * longhelp) {
   // Is there still a free slot?
-  if( cmd_descs_count >= CMD_REGISTRATION_SLOTS ) { Serial.print(F("ERROR: command '")); Serial.print(name); Serial.print( F("' can not be registered (too many)\n") ); return -1; }
+  if( cmd_descs_count >= CMD_REGISTRATION_SLOTS ) { cmd_out.print(F("ERROR: command '")); cmd_out.print(f(name)); cmd_out.print( F("' can not be registered (too many)\n") ); cmd_outflush(); return -1; }
   int slot = cmd_descs_count;
-  #if 0
-    // Command list is kept in alphabetical order (otherwise: registration order)
-    while( slot>0 && strcmp(name,cmd_descs[slot-1].name)<0 ) {
-      cmd_descs[slot] = cmd_descs[slot-1];
-      slot--;
-    }
-  #endif
+  // Command list is kept in alphabetical order; it is the index for cmd_find()
+  while( slot>0 && cmd_strcmp_PP(name,cmd_descs[slot-1].name)<0 ) {
+    cmd_descs[slot] = cmd_descs[slot-1];
+    slot--;
+  }
   cmd_descs_count++;
   
   cmd_descs[slot].main= main;
   cmd_descs[slot].name= name;
   cmd_descs[slot].shorthelp= shorthelp;
   cmd_descs[slot].longhelp= longhelp;
+  cmd_descs_gen++;
   
   return CMD_REGISTRATION_SLOTS - cmd_descs_count;
 }
 
 
-// Finds the command descriptor for a command with name `name`.
-// When not found, returns 0.
-static cmd_desc_t * cmd_find(char * name ) {
-  for( int i=0; i<cmd_descs_count; i++ ) {
-    if( cmd_isprefix(cmd_descs[i].name,name) ) return &cmd_descs[i];
+// Compares `prefix` with the start of `str` (like strncmp, with n the length of `prefix`).
+// Returns 0 iff `prefix` is a prefix of `str`. Note `str` must be in PROGMEM (`prefix` in RAM)
+static int cmd_cmpprefix(/*PROGMEM*/const char *str, const char *prefix) {
+  while( *prefix!='\0') {
+    byte b= pgm_read_byte(str);
+    if( b!=(byte)*prefix ) return b<(byte)*prefix ? -1 : +1;
+    str++;
+    prefix++;
   }
   return 0;
 }
 
 
-// The state machine for receiving characters via Serial
-static char       cmd_buf[CMD_BUFSIZE];              // Incoming chars
-static int        cmd_ix;                            // Fill pointer into cmd_buf
-static bool       cmd_echo;                          // Command interpreter should echo incoming chars
-static cmd_func_t cmd_streamfunc;                    // If 0, no streaming, else the streaming handler
-static char       cmd_streamprompt[CMD_PROMPT_SIZE]; // If streaming (cmd_stream_main!=0), the streaming prompt
+// Searches `name` in the sorted descriptors first..last-1 (indices as for cmd_desc_name).
+// Returns the number of matches (0, 1 or 2, where 2 means "2 or more"), the index of the first match in *ix, 
+// and whether that first match is exact in *exact.
+// Since the descriptors are sorted, this is a binary search: O(log(count)*strlen(name)).
+static int cmd_findin(int first, int last, const char * name, int * ix, bool * exact) {
+  // Find the first command that is not (alphabetically) before `name`
+  int lo= first;
+  int hi= last;
+  while( lo<hi ) {
+    int mid= (lo+hi)/2;
+    if( cmd_cmpprefix(cmd_desc_name(mid),name)<0 ) lo= mid+1; else hi= mid;
+  }
+  *ix= lo;
+  if( lo==last || cmd_cmpprefix(cmd_desc_name(lo),name)!=0 ) return 0; // not found
+  // An exact match sorts before its extensions ("stat" before "status")
+  *exact= pgm_read_byte(cmd_desc_name(lo)+strlen(name))=='\0';
+  return lo+1<last && cmd_cmpprefix(cmd_desc_name(lo+1),name)==0 ? 2 : 1;
+}
+
+
+// Finds the command descriptor for a command with name `name` (which may be abbreviated), and copies it to *d.
+// When not found, returns false. When `name` is a prefix of several commands (and not equal 
+// to one of them), also returns false but with *ambiguous set to true.
+// Both the flash table and cmd_descs[] are searched; on an exact match in both, the flash table wins.
+static bool cmd_find(const char * name, cmd_desc_t * d, bool * ambiguous ) {
+  int ix1, ix2;
+  bool exact1= false, exact2= false;
+  int n1= cmd_findin(0, cmd_table_count, name, &ix1, &exact1);
+  int n2= cmd_findin(cmd_table_count, cmd_table_count+cmd_descs_count, name, &ix2, &exact2);
+  *ambiguous= false;
+  if( exact1 ) { cmd_desc_get(ix1,d); return true; }
+  if( exact2 ) { cmd_desc_get(ix2,d); return true; }
+  // An abbreviation must be unique
+  if( n1+n2>1 ) { *ambiguous= true; return false; }
+  if( n1==1 ) { cmd_desc_get(ix1,d); return true; }
+  if( n2==1 ) { cmd_desc_get(ix2,d); return true; }
+  return false;
+}
+
+
+// Profiling =======================================================================
+
+
+#if CMD_PROF || CMD_TRACE
+// Names for the handlers that are not commands (also used by the trace)
+static const char cmd_prof_stream[] PROGMEM = "(stream)";
+static const char cmd_prof_raw[]    PROGMEM = "(raw)";
+#endif
+
+
+#if CMD_PROF
+
+
+// The counters of one command (or streaming handler)
+typedef struct cmd_prof_s {
+  const char * name;   // PROGMEM name of the command, 0 for a free slot
+  uint32_t     count;  // Number of invocations
+  uint32_t     min;    // Shortest execution time (us)
+  uint32_t     max;    // Longest execution time (us)
+  uint32_t     sum;    // Total execution time (us), for the mean
+  uint32_t     echoed; // Number of bytes echoed for the lines of this command
+  uint32_t     out;    // Number of bytes output by this command
+} cmd_prof_t;
+
+
+// The per-command counters, and the interpreter-wide counters
+static cmd_prof_t cmd_profs[CMD_PROF_SLOTS];
+static struct cmd_prof_all_s {
+  uint32_t lines;     // Number of lines executed
+  uint32_t exec;      // Time (us) in cmd_exec() outside the handlers (splitting, lookup)
+  uint32_t full;      // Number of chars dropped because buf was full (the "_\b" alarm)
+  uint32_t overflows; // Number of (serial) overflows detected by the poll functions
+  uint32_t untracked; // Number of invocations not counted because all slots were in use
+  uint32_t last;      // Execution time of the last handler (to compute exec)
+} cmd_prof_all;
+
+
+// Name for the binary frame handler
+static const char cmd_prof_bin[]    PROGMEM = "(binary)";
+
+
+// Adds an invocation of `name` (in PROGMEM) that took `us` and output `out` bytes; the bytes echoed for the line are added too
+static void cmd_prof_record(const char * name, uint32_t us, uint32_t out) {
+  cmd_prof_all.last+= us;
+  // Find the slot of `name` (or a free one)
+  cmd_prof_t * p= cmd_profs;
+  while( p<cmd_profs+CMD_PROF_SLOTS && p->name!=0 && p->name!=name ) p++;
+  if( p==cmd_profs+CMD_PROF_SLOTS ) { cmd_prof_all.untracked++; return; }
+  if( p->name==0 ) { p->name= name; p->min= UINT32_MAX; }
+  p->count++;
+  if( us<p->min ) p->min= us;
+  if( us>p->max ) p->max= us;
+  p->sum+= us;
+  p->echoed+= cmd_cur->profechoed;
+  p->out+= out;
+  cmd_cur->profechoed= 0;
+}
+
+
+// Calls a handler: `call` is executed, timed and recorded under `name`
+#define CMD_PROF_CALL(name,call) do { uint32_t t_= micros(); uint32_t o_= cmd_cur->outstats.bytes; call; cmd_prof_record(name, micros()-t_, cmd_cur->outstats.bytes-o_); } while( 0 )
+// Steps interpreter-wide counter `counter` with `n`
+#define CMD_PROF_STEP(counter,n) ( cmd_prof_all.counter+= (n) )
+// Adds `n` echoed bytes to the line being entered
+#define CMD_PROF_ECHO(n) ( cmd_cur->profechoed+= (n) )
+
+
+#else
+
+
+#define CMD_PROF_CALL(name,call) call
+#define CMD_PROF_STEP(counter,n) ((void)0)
+#define CMD_PROF_ECHO(n) ((void)0)
+
+
+#endif
+
+
+// Trace ===========================================================================
+
+
+#if CMD_TRACE
+
+
+// The ring of the last CMD_TRACE_SIZE executed lines
+static cmd_trace_t cmd_traces[CMD_TRACE_SIZE];
+static uint32_t    cmd_trace_count; // Number of lines ever recorded; the next goes to cmd_traces[cmd_trace_count%CMD_TRACE_SIZE]
+
+
+// Records a line handled by `name` (PROGMEM, 0 when not found), with `len` argument chars at `s`; returns its entry
+static cmd_trace_t * cmd_trace_put(const char * name, const char * s, int len) {
+  cmd_trace_t * t= &cmd_traces[cmd_trace_count++ % CMD_TRACE_SIZE];
+  t->ms= millis();
+  t->us= 0;
+  t->name= name;
+  t->status= CMD_OK;
+  t->len= len>255 ? 255 : len;
+  memcpy(t->args, s, len<CMD_TRACE_ARGSIZE ? len : CMD_TRACE_ARGSIZE);
+  return t;
+}
+
+
+// Completes entry `t`: the handler started at `start` (micros) and has finished
+static void cmd_trace_end(cmd_trace_t * t, uint32_t start) {
+  t->us= micros()-start;
+  t->status= cmd_cur->status;
+}
+
+
+const cmd_trace_t * cmd_trace_get(int age) {
+  if( age<0 || (uint32_t)age>=cmd_trace_count || age>=CMD_TRACE_SIZE ) return 0;
+  return &cmd_traces[(cmd_trace_count-1-age) % CMD_TRACE_SIZE];
+}
+
+
+// Starts the trace of a line (in cmd_exec)
+#define CMD_TRACE_BEGIN() uint32_t trace_us_= micros(); cmd_trace_t * trace_= 0
+// Records the line: handled by `name`, with `len` argument chars at `s` (must precede the handler, it may reuse buf)
+#define CMD_TRACE_PUT(name,s,len) ( trace_= cmd_trace_put(name,s,len) )
+// Completes the trace of the line: duration and status
+#define CMD_TRACE_END() cmd_trace_end(trace_, trace_us_)
+
+
+#else
+
+
+#define CMD_TRACE_BEGIN() ((void)0)
+#define CMD_TRACE_PUT(name,s,len) ((void)0)
+#define CMD_TRACE_END() ((void)0)
+
+
+#endif
+
+
+// Tokenizer =======================================================================
+
+
+// The line is tokenized while it is entered (by cmd_add and cmd_addbuf), so that cmd_exec() does not scan it:
+// the separators (spaces and tabs) are replaced by '\0' and the start of each argument is kept in argv[];
+// the first "//" (comment) and the first ';' before it (next command; not in streaming mode) are recorded, the chars after them are not tokenized;
+// the command (the first argument) is looked up char by char: a range of commands that is narrowed with each char.
+// A backspace undoes the last char; only one in the command redoes its lookup.
+// Raw streaming lines are not tokenized.
+
+
+// Narrows the range of commands to those with char `c` at index `k` of their name (the names in it share their first k chars)
+static void cmd_tok_narrow(int k, char c) {
+  for( int t=0; t<2; t++ ) {
+    // The names with c at k are a run (sorted): find its start lo and its end hi
+    int lo= cmd_cur->findlo[t];
+    int hi= cmd_cur->findhi[t];
+    while( lo<hi ) {
+      int mid= (lo+hi)/2;
+      if( pgm_read_byte(cmd_desc_name(mid)+k) < (byte)c ) lo= mid+1; else hi= mid;
+    }
+    hi= cmd_cur->findhi[t];
+    int end= lo;
+    while( end<hi ) {
+      int mid= (end+hi)/2;
+      if( pgm_read_byte(cmd_desc_name(mid)+k) <= (byte)c ) end= mid+1; else hi= mid;
+    }
+    cmd_cur->findlo[t]= lo;
+    cmd_cur->findhi[t]= end;
+  }
+  cmd_cur->findlen= k+1;
+}
+
+
+// Returns the start of the first argument in buf (there must be one). Separators are already '\0', so without 
+// argv (see CMD_ARGV_SCRATCH) it is the first char that is not.
+static char * cmd_tok_arg0(void) {
+  if( cmd_cur->argv ) return cmd_cur->argv[0];
+  char * s= cmd_cur->buf;
+  while( *s=='\0' ) s++;
+  return s;
+}
+
+
+// Restarts the lookup of the command, and narrows it with the chars of the first argument before index `end` in buf
+static void cmd_tok_refind(int end) {
+  cmd_cur->findlo[0]= 0;
+  cmd_cur->findhi[0]= cmd_table_count;
+  cmd_cur->findlo[1]= cmd_table_count;
+  cmd_cur->findhi[1]= cmd_table_count+cmd_descs_count;
+  cmd_cur->findlen= 0;
+  cmd_cur->findgen= cmd_descs_gen;
+  if( cmd_cur->argc==0 ) return;
+  const char * s= cmd_tok_arg0();
+  if( *s=='@' ) s++;
+  for( int k=0; s+k<cmd_cur->buf+end && s[k]!='\0'; k++ ) cmd_tok_narrow(k, s[k]);
+}
+
+
+// Clears the tokenizer state (for a new line in buf)
+static void cmd_tok_reset(void) {
+  cmd_cur->argc= 0;
+  cmd_cur->cmt= -1;
+  cmd_cur->semi= -1;
+  cmd_tok_refind(0);
+}
+
+
+static void cmd_tok_del(int p);
+
+
+// Tokenizes char buf[p], which was just added at the end of the line
+static void cmd_tok_add(int p) {
+  char * buf= cmd_cur->buf;
+  if( cmd_cur->streamrawfunc || cmd_cur->cmt>=0 ) return;
+  char c= buf[p];
+  if( c=='/' && p>0 && buf[p-1]=='/' ) { 
+    // Undo the first '/', it is part of the comment
+    if( cmd_cur->semi<0 ) cmd_tok_del(p-1); 
+    cmd_cur->cmt= p-1; 
+    return; 
+  }
+  if( cmd_cur->semi>=0 ) return;
+  if( c==';' && !cmd_cur->nosplit && !cmd_cur->streamfunc ) { cmd_cur->semi= p; return; } // Streaming data is not split
+  if( c==' ' || c=='\t' ) { buf[p]= '\0'; return; }
+  if( p==0 || buf[p-1]=='\0' ) {
+    // Start of an argument
+    if( cmd_cur->argv && cmd_cur->argc<cmd_cur->maxargs ) cmd_cur->argv[cmd_cur->argc]= &buf[p];
+    cmd_cur->argc++;
+  }
+  if( cmd_cur->argc==1 && cmd_cur->findgen==cmd_descs_gen && !cmd_cur->streamfunc ) {
+    const char * arg0= cmd_tok_arg0();
+    int k= &buf[p]-arg0;
+    if( *arg0=='@' ) k--;
+    if( k>=0 ) cmd_tok_narrow(k, c);
+  }
+}
+
+
+// Undoes the tokenizing of buf[p], the last char of the line, which is about to be removed
+static void cmd_tok_del(int p) {
+  char * buf= cmd_cur->buf;
+  if( cmd_cur->streamrawfunc ) return;
+  if( cmd_cur->cmt>=0 ) {
+    // Removing the second '/' of the comment makes the first one a normal char again
+    if( p==cmd_cur->cmt+1 ) { cmd_cur->cmt= -1; cmd_tok_add(p-1); }
+    return;
+  }
+  if( cmd_cur->semi>=0 ) {
+    if( p==cmd_cur->semi ) cmd_cur->semi= -1;
+    return;
+  }
+  if( buf[p]=='\0' ) return; // A separator: the argument before it continues
+  bool start= p==0 || buf[p-1]=='\0';
+  if( start ) cmd_cur->argc--;
+  if( start ? cmd_cur->argc==0 : cmd_cur->argc==1 ) cmd_tok_refind(p); // A char of the command
+}
+
+
+// Looks up the command of the tokenized line (see cmd_find); there is no search when the line was entered char by char.
+static bool cmd_tok_find(cmd_desc_t * d, bool * ambiguous) {
+  if( cmd_cur->findgen!=cmd_descs_gen ) {
+    // Commands were registered while the line was entered
+    int end= cmd_cur->semi>=0 ? cmd_cur->semi : cmd_cur->cmt>=0 ? cmd_cur->cmt : cmd_cur->ix;
+    cmd_tok_refind(end);
+  }
+  int n1= cmd_cur->findhi[0]-cmd_cur->findlo[0];
+  int n2= cmd_cur->findhi[1]-cmd_cur->findlo[1];
+  bool exact1= n1>0 && pgm_read_byte(cmd_desc_name(cmd_cur->findlo[0])+cmd_cur->findlen)=='\0';
+  bool exact2= n2>0 && pgm_read_byte(cmd_desc_name(cmd_cur->findlo[1])+cmd_cur->findlen)=='\0';
+  *ambiguous= false;
+  if( exact1 ) { cmd_desc_get(cmd_cur->findlo[0],d); return true; }
+  if( exact2 ) { cmd_desc_get(cmd_cur->findlo[1],d); return true; }
+  // An abbreviation must be unique
+  if( n1+n2>1 ) { *ambiguous= true; return false; }
+  if( n1==1 ) { cmd_desc_get(cmd_cur->findlo[0],d); return true; }
+  if( n2==1 ) { cmd_desc_get(cmd_cur->findlo[1],d); return true; }
+  return false;
+}
 
 
 // Print the prompt when waiting for input (special variant when in streaming mode). Needed once after init().
 void cmd_prompt() {
-  if( cmd_streamfunc ) {
-    Serial.print( cmd_streamprompt );
+  if( CMD_ISBINARY() || CMD_ISBATCH() || cmd_cur->captured ) {
+    // No prompt in binary mode and batch mode (and for submitted lines)
+  } else if( cmd_cur->streamfunc || cmd_cur->streamrawfunc ) {
+#if CMD_STREAMPROMPT
+    cmd_out.print( cmd_cur->streamprompt );
+#else
+    cmd_out.print( F("> ") );
+#endif
   } else {
-    Serial.print( F(">> ") );  
+    cmd_out.print( F(">> ") );  
+  }
+}
+
+
+// Initializes interpreter instance `cmd` on `stream` with the buffers of `cfg`.
+void cmd_init(cmd_t * cmd, Stream * stream, int rxsize, const cmd_cfg_t * cfg) {
+  memset(cmd, 0, sizeof *cmd);
+  cmd->stream= stream;
+  cmd->rxsize= rxsize;
+  cmd->buf= cfg->buf;
+  cmd->bufsize= cfg->bufsize;
+  cmd->argv= cfg->argv;
+  cmd->maxargs= cfg->maxargs;
+  cmd->streamprompt= cfg->streamprompt;
+  cmd->promptsize= cfg->promptsize;
+  cmd->outbuf= cfg->outbuf;
+  cmd->outsize= cfg->outsize;
+  cmd->streamprompt[0]= '\0';
+  cmd->echo= true;
+#if CMD_FLOW
+  cmd->flowhigh= CMD_FLOW_HIGH;
+  cmd->flowlow= CMD_FLOW_LOW;
+#endif
+  cmd_t * prev= cmd_select(cmd);
+  cmd_tok_reset();
+  cmd_out.print( F("cmd  : init\n") ); 
+  cmd_outflush(); // The application probably prints to the stream next
+  cmd_select(prev);
+}
+
+
+// Initializes interpreter instance `cmd` on `stream`, with buffers of the default sizes on the heap.
+// They are allocated on the first init only (so `cmd` must be all zeros then, e.g. a global); 
+// a failing allocation leaves `cmd` uninitialized.
+void cmd_init(cmd_t * cmd, Stream * stream, int rxsize) {
+  cmd_cfg_t cfg= { cmd->buf, CMD_BUFSIZE, cmd->argv, CMD_MAXARGS, cmd->streamprompt, CMD_PROMPT_SIZE, cmd->outbuf, CMD_OUTSIZE };
+  if( cfg.buf==0 || cmd->bufsize!=CMD_BUFSIZE || cmd->maxargs!=CMD_MAXARGS || cmd->promptsize!=CMD_PROMPT_SIZE || cmd->outsize!=CMD_OUTSIZE ) {
+    // One block: argv (unless CMD_ARGV_SCRATCH), buf, streamprompt, outbuf (if CMD_OUTSIZE>0)
+    int argvsize= CMD_ARGV_SCRATCH ? 0 : CMD_MAXARGS*sizeof(char *);
+    uint8_t * mem= (uint8_t *)malloc(argvsize+CMD_BUFSIZE+CMD_PROMPT_SIZE+CMD_OUTSIZE);
+    if( mem==0 ) return;
+    cfg.argv= argvsize>0 ? (char **)mem : 0;
+    cfg.buf= (char *)mem+argvsize;
+    cfg.streamprompt= cfg.buf+CMD_BUFSIZE;
+    cfg.outbuf= CMD_OUTSIZE>0 ? (uint8_t *)cfg.buf+CMD_BUFSIZE+CMD_PROMPT_SIZE : 0;
   }
+  cmd_init(cmd, stream, rxsize, &cfg);
 }
 
 
-// Initializes the command interpreter.
+// Initializes the command interpreter (the default instance, on Serial).
 void cmd_init() {
-  cmd_ix= 0;
-  cmd_echo= true;
-  cmd_streamfunc= 0;
-  cmd_streamprompt[0]= 0;
-  Serial.print( F("cmd  : init\n") ); 
+  // The configuration is only needed here (a static one would be RAM on AVR)
+  cmd_cfg_t cfg= { cmd_serial_buf, CMD_BUFSIZE, cmd_serial_argv, CMD_MAXARGS, cmd_serial_prompt, CMD_PROMPT_SIZE, cmd_serial_outbuf, CMD_OUTSIZE };
+  cmd_init(&cmd_serial, &Serial, CMD_SERIAL_RXSIZE, &cfg);
+  cmd_select(&cmd_serial);
 }
 
 
-// Execute the entered command (terminated with a press on RETURN key)
-static void cmd_exec() {
-  char * argv[ CMD_MAXARGS ];
-  // Cut a trailing comment
-  char * cmt= strstr(cmd_buf,"//");
-  if( cmt!=0 ) { *cmt='\0'; cmd_ix= cmt-cmd_buf; } // trim comment
-  // Find the arguments (set up argv/argc)
-  int argc= 0;
-  int ix=0;
-  while( ix<cmd_ix ) {
-    // scan for begin of word (ie non-space)
-    while( (ix<cmd_ix) && ( cmd_buf[ix]==' ' || cmd_buf[ix]=='\t' ) ) ix++;
-    if( !(ix<cmd_ix) ) break;
-    argv[argc]= &cmd_buf[ix];
-    argc++;
-    if( argc>CMD_MAXARGS ) { Serial.print(F("ERROR: too many arguments\n"));  return; }
-    // scan for end of word (ie space)
-    while( (ix<cmd_ix) && ( cmd_buf[ix]!=' ' && cmd_buf[ix]!='\t' ) ) ix++;
-    cmd_buf[ix]= '\0';
-    ix++;
+// Execute the entered command (terminated with a press on RETURN key), with the arguments in `argv`
+static void cmd_exec_argv(char ** argv) {
+  CMD_TRACE_BEGIN();
+  // Check for raw streaming: pass the line as is
+  if( cmd_cur->streamrawfunc ) {
+    CMD_TRACE_PUT( cmd_prof_raw, cmd_cur->buf, cmd_cur->ix );
+    cmd_outsync();
+    CMD_PROF_CALL( cmd_prof_raw, cmd_cur->streamrawfunc(cmd_cur->buf, cmd_cur->ix) );
+    CMD_TRACE_END();
+    return;
+  }
+  // The arguments were found, and the command was looked up, while the line was entered (see cmd_tok_add)
+  int argc= cmd_cur->argc;
+  if( argc>cmd_cur->maxargs ) { 
+    CMD_TRACE_PUT( 0, cmd_tok_arg0(), cmd_cur->ix-(cmd_tok_arg0()-cmd_cur->buf) );
+    cmd_out.print(F("ERROR: too many arguments\n")); cmd_set_status(CMD_ERR_ARGS);
+    CMD_TRACE_END();
+    return; 
   }
-  //for(ix=0; ix<argc; ix++) { Serial.print(ix); Serial.print("='"); Serial.print(argv[ix]); Serial.print("'"); Serial.print("\n"); }
   // Check from streaming
-  if( cmd_streamfunc ) {
-    cmd_streamfunc(argc, argv); // Streaming mode is active pass the data
+  if( cmd_cur->streamfunc ) {
+    CMD_TRACE_PUT( cmd_prof_stream, argc==0 ? cmd_cur->buf : argv[0], argc==0 ? 0 : cmd_cur->ix-(argv[0]-cmd_cur->buf) );
+    cmd_outsync();
+    CMD_PROF_CALL( cmd_prof_stream, cmd_cur->streamfunc(argc, argv) ); // Streaming mode is active pass the data
+    CMD_TRACE_END();
     return;
   }
   // Bail out when empty
@@ -117,94 +836,837 @@ static void cmd_exec() {
   // Find the command
   char * s= argv[0];
   if( *s=='@' ) s++;
-  cmd_desc_t * d= cmd_find(s);
+  bool ambiguous;
+  cmd_desc_t d;
   // If a command is found, execute it 
-  if( d!=0 ) {
-    cmd_ix = 0; // Added because there might be a command that issues a command
-    d->main(argc, argv ); // Execute handler of command
+  if( cmd_tok_find(&d,&ambiguous) ) {
+    CMD_TRACE_PUT( d.name, argc==1 ? argv[0] : argv[1], argc==1 ? 0 : cmd_cur->ix-(argv[1]-cmd_cur->buf) );
+    cmd_cur->ix = 0; // Added because there might be a command that issues a command
+    cmd_tok_reset(); // Note that such a command reuses buf and argv
+    cmd_outsync();
+    CMD_PROF_CALL( d.name, d.main(argc, argv) ); // Execute handler of command
+    CMD_TRACE_END();
     return;
   } 
-  Serial.print(F("ERROR: command '")); 
-  Serial.print(s); 
-  Serial.print(F("' not found (try help)\n")); 
+  CMD_TRACE_PUT( 0, argv[0], cmd_cur->ix-(argv[0]-cmd_cur->buf) );
+  cmd_out.print(F("ERROR: command '")); 
+  cmd_out.print(s); 
+  cmd_out.print(ambiguous ? F("' ambiguous (try help)\n") : F("' not found (try help)\n")); 
+  cmd_set_status(ambiguous ? CMD_ERR_AMBIGUOUS : CMD_ERR_NOTFOUND);
+  CMD_TRACE_END();
+}
+
+
+// Execute the entered command, with the argv of the instance, or one built in scratch (see CMD_ARGV_SCRATCH)
+static void cmd_exec() {
+  int argc= cmd_cur->argc;
+  if( cmd_cur->argv || cmd_cur->streamrawfunc || argc>cmd_cur->maxargs ) { cmd_exec_argv(cmd_cur->argv); return; }
+  char ** argv= (char **)cmd_scratch_alloc( (argc>0 ? argc : 1)*sizeof(char *) );
+  if( argv==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); return; }
+  // The tokenizer replaced the separators by '\0' (up to the end of the command, where cmd_execline put a '\0')
+  int n= 0;
+  for( char * p= cmd_cur->buf; n<argc; p++ ) {
+    if( *p!='\0' && (p==cmd_cur->buf || p[-1]=='\0') ) argv[n++]= p;
+  }
+  cmd_exec_argv(argv);
+  cmd_scratch_free(argv);
+}
+
+
+#if CMD_BATCH
+// Prints the status frame of the last command (batch mode): "#<seq> OK" or "#<seq> ERR <code>"
+static void cmd_frame( void ) {
+  cmd_out.print('#'); 
+  cmd_out.print(cmd_cur->seq++);
+  if( cmd_cur->status==CMD_OK ) { 
+    cmd_out.print(F(" OK\n")); 
+  } else { 
+    cmd_out.print(F(" ERR ")); cmd_out.print(cmd_cur->status); cmd_out.print(F("\n")); 
+  }
+}
+#else
+static void cmd_frame( void ) { } // Not called (see CMD_ISBATCH)
+#endif
+
+
+// Returns true iff `s` consists of spaces and tabs only
+static bool cmd_isblank(const char * s) {
+  while( *s==' ' || *s=='\t' ) s++;
+  return *s=='\0';
+}
+
+
+// Execute the entered line: the commands on it (separated by ';') one after the other.
+// The line was tokenized while it was entered, up to the first ';'. While a command executes, the rest of 
+// the line waits in scratch; then it is moved back to buf and tokenized. When a command starts a task, 
+// the rest of the line becomes type-ahead: it executes when the task ends.
+// In batch mode each command is followed by its status frame (for a task, the frame follows when it ends).
+static void cmd_execline() {
+  static int depth= 0; // A command may itself add lines; those get no status frame
+  uint8_t status= cmd_cur->status; 
+  depth++;
+  // Cut a trailing comment
+  if( cmd_cur->cmt>=0 ) { cmd_cur->buf[cmd_cur->cmt]='\0'; cmd_cur->ix= cmd_cur->cmt; } 
+  for(;;) {
+    // Move the commands after the first ';' out of buf
+    int semi= cmd_cur->semi;
+    char * rest= 0;
+    int restlen= 0;
+    cmd_cur->status= CMD_OK;
+    if( semi>=0 ) {
+      restlen= cmd_cur->ix-(semi+1);
+      rest= (char *)cmd_scratch_alloc( restlen+1 );
+      if( rest==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); }
+      else { memcpy(rest, &cmd_cur->buf[semi+1], restlen+1); cmd_cur->buf[semi]='\0'; cmd_cur->ix= semi; }
+    }
+    bool blank= cmd_cur->streamrawfunc ? cmd_isblank(cmd_cur->buf) : cmd_cur->argc==0;
+    if( semi<0 || rest!=0 ) cmd_exec();
+    cmd_cur->ix= 0;
+    cmd_tok_reset();
+    if( CMD_ISBATCH() && depth==1 && !blank && !cmd_cur->taskfunc ) cmd_frame();
+    if( rest==0 ) break;
+    // Move the rest back to buf
+    memcpy(cmd_cur->buf, rest, restlen+1);
+    cmd_cur->ix= restlen;
+    cmd_scratch_free(rest);
+    if( cmd_cur->taskfunc ) { cmd_cur->buf[cmd_cur->ix++]= '\n'; break; } // Type-ahead, executes after the task
+    for( int p=0; p<restlen; p++ ) cmd_tok_add(p);
+  }
+  depth--;
+  if( depth>0 ) cmd_cur->status= status; // The line of a command that adds lines is not done yet
+}
+
+
+#if CMD_BINARY
+// Appends a decoded byte of a binary frame to buf
+static void cmd_addbinbyte(byte b) {
+  if( cmd_cur->ix<cmd_cur->bufsize ) cmd_cur->buf[cmd_cur->ix++]= b; else cmd_cur->bin_bad= true;
+}
+
+
+// Add a byte to the COBS decoder (binary mode); a 0x00 completes a frame, which is then checked and passed to binfunc
+static void cmd_addbin(byte b) {
+  // The '\n' of the "\r\n" that ended the line enabling binary mode is not a code byte
+  if( cmd_cur->bin_lf ) { 
+    cmd_cur->bin_lf= false; 
+    if( b=='\n' ) return; 
+  }
+  if( b!=0 ) {
+    if( cmd_cur->bin_rem==0 ) {
+      // Code byte: b-1 data bytes follow, and then an (implicit) zero, unless b is 0xFF
+      if( cmd_cur->bin_zero ) cmd_addbinbyte(0);
+      cmd_cur->bin_rem= b-1;
+      cmd_cur->bin_zero= b!=0xFF;
+    } else {
+      cmd_addbinbyte(b);
+      cmd_cur->bin_rem--;
+    }
+    return;
+  }
+  // Frame delimiter; an empty frame (e.g. a 0x00 sent to resync) is ignored
+  if( cmd_cur->ix>0 || cmd_cur->bin_rem>0 || cmd_cur->bin_bad ) {
+    int len= cmd_cur->ix-2; // payload length
+    const uint8_t * data= (const uint8_t *)cmd_cur->buf;
+    if( cmd_cur->bin_rem>0 || cmd_cur->bin_bad || len<0 || cmd_crc16(data,len) != (data[len] | data[len+1]<<8) ) {
+      cmd_steperrorcount(); // Truncated, too long or corrupt frame
+    } else if( len==0 ) {
+      cmd_cur->binfunc= 0; // Sentinel: back to text mode
+      cmd_cur->ix= 0;
+      cmd_prompt();
+    } else {
+      cmd_outsync();
+      CMD_PROF_CALL( cmd_prof_bin, cmd_cur->binfunc(data,len) );
+    }
+  }
+  cmd_cur->ix= 0;
+  cmd_cur->bin_rem= 0;
+  cmd_cur->bin_zero= false;
+  cmd_cur->bin_bad= false;
+}
+#endif
+
+
+// Ends the task of the current instance, and replays the input that was typed ahead while it ran
+static void cmd_endtask( bool cancel ) {
+  cmd_cur->taskfunc= 0;
+  if( cancel ) {
+    cmd_cur->ix= 0; // Cancel also discards the type-ahead
+    cmd_out.print( F("^C\n") );
+    cmd_set_status(CMD_ERR_CANCEL);
+  }
+  if( CMD_ISBATCH() ) cmd_frame(); // The status frame of the command that started the task
+  cmd_prompt();
+  int len= cmd_cur->ix;
+  char * ahead= (char *)cmd_scratch_alloc(len);
+  if( len>0 && ahead!=0 ) {
+    memcpy(ahead, cmd_cur->buf, len);
+    cmd_cur->ix= 0;
+    cmd_addbuf(ahead, len);
+  } else {
+    cmd_cur->ix= 0; // Type-ahead lost (out of scratch memory)
+  }
+  cmd_scratch_free(ahead);
+}
+
+
+// Steps the task of the current instance (if there is one)
+static void cmd_steptask( void ) {
+  if( cmd_cur->taskfunc==0 ) return;
+  if( cmd_cur->taskfunc(&cmd_cur->taskstate, false) ) return; // Task not yet done
+  cmd_endtask(false);
+}
+
+
+// Starts a task on the current instance; it is stepped by the poll functions until it returns false.
+void cmd_start_task( cmd_taskfunc_t func, uint32_t state ) {
+  cmd_cur->taskfunc= func;
+  cmd_cur->taskstate= state;
+}
+
+
+// Returns true iff the current instance is running a task.
+bool cmd_task_active( void ) {
+  return cmd_cur->taskfunc!=0;
 }
 
 
-// Add characters to the state machine of the command interpreter (firing a command on <CR>)
+// Add characters to the state machine of the (current) command interpreter (firing a command on <CR>)
 void cmd_add(int ch) {
-  if( ch=='\n' || ch=='\r' ) {
-    if( cmd_echo ) Serial.print(F("\n"));
-    cmd_buf[cmd_ix]= '\0'; // Terminate (make cmd_buf a c-string)
-    cmd_exec();
-    cmd_ix=0;
-    cmd_prompt(); // trigger for tests that cmd is finished
+  if( cmd_cur->buf==0 ) return; // Not initialized
+  CMD_SCRATCH_OPEN();
+  if( cmd_cur->taskfunc && !CMD_ISBINARY() ) {
+    // A task is running: CMD_CANCEL cancels it, other chars are type-ahead, kept in buf (without echo) until the task ends.
+    // The poll functions read no more than fits (see cmd_feedroom), so the alarm is only for direct callers.
+    if( ch==CMD_CANCEL ) {
+      cmd_cur->taskfunc(&cmd_cur->taskstate, true);
+      cmd_endtask(true);
+    } else if( cmd_cur->ix<cmd_cur->bufsize-1 ) {
+      cmd_cur->buf[cmd_cur->ix++]= ch;
+    } else {
+      cmd_out.print( F("_\b") ); 
+      CMD_PROF_STEP(full,1);
+    }
+#if CMD_BINARY
+  } else if( cmd_cur->binfunc ) {
+    cmd_addbin(ch);
+#endif
+  } else if( ch=='\n' || ch=='\r' ) {
+    if( cmd_echoing() ) { cmd_out.print(F("\n")); CMD_PROF_ECHO(1); }
+    cmd_cur->buf[cmd_cur->ix]= '\0'; // Terminate (make buf a c-string)
+#if CMD_FLOW
+    if( cmd_cur->ix>cmd_cur->flowstats.bufpeak ) cmd_cur->flowstats.bufpeak= cmd_cur->ix;
+    // A slow line is probably followed by another one: stop the sender while that executes
+    if( cmd_cur->flowslow ) cmd_flowstop();
+#endif
+#if CMD_STATS
+    if( cmd_cur->waking && cmd_cur->wakestats ) cmd_stats_add(cmd_cur->wakestats, micros()-cmd_cur->wakeus);
+#endif
+#if CMD_PROF || CMD_FLOW
+    uint32_t start= micros();
+#endif
+#if CMD_PROF
+    uint32_t last= cmd_prof_all.last; // A handler may itself add lines
+    cmd_prof_all.last= 0;
+    cmd_execline();
+    cmd_prof_all.exec+= micros()-start-cmd_prof_all.last;
+    cmd_prof_all.last= last;
+    cmd_prof_all.lines++;
+    cmd_cur->profechoed= 0; // In case no handler was called
+#else
+    cmd_execline();
+#endif
+#if CMD_FLOW
+    cmd_cur->flowslow= micros()-start >= CMD_FLOW_SLOWUS;
+#endif
+#if CMD_BINARY
+    if( cmd_cur->binfunc ) cmd_cur->bin_lf= ch=='\r'; // The line switched to binary mode: it may end in "\r\n"
+#endif
+    if( !cmd_cur->taskfunc ) cmd_prompt(); // trigger for tests that cmd is finished (if it started a task, when that ends)
   } else if( ch=='\b' ) {
-    if( cmd_ix>0 ) {
-      if( cmd_echo ) Serial.print( F("\b \b") );
-      cmd_ix--;
+    if( cmd_cur->ix>0 ) {
+      if( cmd_echoing() ) { cmd_out.print( F("\b \b") ); CMD_PROF_ECHO(3); }
+      cmd_tok_del(cmd_cur->ix-1);
+      cmd_cur->ix--;
     } else {
       // backspace with no more chars in buf; ignore
     }
   } else {
-    if( cmd_ix<CMD_BUFSIZE-1 ) {
-      cmd_buf[cmd_ix++]= ch;
-      if( cmd_echo ) Serial.print( (char)ch );
+    if( cmd_cur->ix<cmd_cur->bufsize-1 ) {
+      cmd_cur->buf[cmd_cur->ix++]= ch;
+      cmd_tok_add(cmd_cur->ix-1);
+      if( cmd_echoing() ) { cmd_out.print( (char)ch ); CMD_PROF_ECHO(1); }
     } else {
       // Input buffer full, send "alarm" back, even with echo off
-      Serial.print( F("_\b") ); // Prefer visual instead of \a (bell)
+      cmd_out.print( F("_\b") ); // Prefer visual instead of \a (bell)
+      CMD_PROF_STEP(full,1);
     }
   }
+  CMD_SCRATCH_CLOSE();
+}
+
+
+// Add all characters of a buffer (don't forget the \n).
+// Same as calling cmd_add() for each char, but a run of ordinary chars (up to the next \n, \r or \b) 
+// is copied to buf with one memcpy (and then tokenized) and echoed with one write.
+void cmd_addbuf(const char * buf, size_t len) {
+  if( cmd_cur->buf==0 ) return; // Not initialized
+  CMD_SCRATCH_OPEN();
+  while( len>0 ) {
+    // In binary mode there are no ordinary chars, and while a task runs, chars are type-ahead
+    if( CMD_ISBINARY() || cmd_cur->taskfunc ) {
+      cmd_add(*buf++);
+      len--;
+      continue;
+    }
+    // Find the run of ordinary chars
+    size_t run= 0;
+    while( run<len && buf[run]!='\n' && buf[run]!='\r' && buf[run]!='\b' ) run++;
+    // Copy (and echo) the part of the run that fits
+    size_t room= cmd_cur->bufsize-1-cmd_cur->ix;
+    size_t size= run<room ? run : room;
+    if( size>0 ) {
+      memcpy(&cmd_cur->buf[cmd_cur->ix], buf, size);
+      for( size_t i=0; i<size; i++ ) cmd_tok_add(cmd_cur->ix++);
+      if( cmd_echoing() ) { cmd_out.write(buf, size); CMD_PROF_ECHO(size); }
+    }
+    // Input buffer full, send "alarm" back for every char that did not fit, even with echo off
+    CMD_PROF_STEP(full,run-size);
+    for( ; size<run; size++ ) cmd_out.print( F("_\b") );
+    buf+= run;
+    len-= run;
+    // Process the special char
+    if( len>0 ) {
+      cmd_add(*buf++);
+      len--;
+    }
+  }
+  CMD_SCRATCH_CLOSE();
 }
 
 
 // Add all characters of a string (don't forget the \n)
 void cmd_addstr(const char * str) {
-  while( *str!='\0' ) cmd_add(*str++);  
+  cmd_addbuf(str, strlen(str));
 }
 
 
 // Add all characters of a string (don't forget the \n)
 void cmd_addstr_P(/*PROGMEM*/const char * str) {
-  char ch;
-  while( '\0' != (ch=pgm_read_byte(str++)) ) cmd_add(ch);  
+  // Copy chunks of str in PROGMEM via (scratch) RAM to cmd_addbuf()
+  int len= strlen_P(str);
+  CMD_SCRATCH_OPEN();
+  char * ram= (char *)cmd_scratch_alloc(CMD_POLLSIZE);
+  if( ram==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); CMD_SCRATCH_CLOSE(); return; }
+  while( len>0 ) {
+    int size= len<CMD_POLLSIZE ? len : CMD_POLLSIZE;
+    memcpy_P(ram, str, size);
+    cmd_addbuf(ram, size);
+    str+= size;
+    len-= size;
+  }
+  cmd_scratch_free(ram);
+  CMD_SCRATCH_CLOSE();
 }
 
 
 // Returns the number of (not yet executed) chars.
 int cmd_pendingschars() {
-  return cmd_ix;
+  return cmd_cur->ix;
+}
+
+
+// Scripts =========================================================================
+
+
+#if CMD_PROF
+static const char cmd_prof_script[] PROGMEM = "(script)";
+#endif
+
+
+// Runs all steps of `script`, `loops` times. With `timing`, prints the execution time of each step.
+// Each line is copied from PROGMEM and cut at the spaces; the handler is known, so there is no lookup.
+static uint32_t cmd_script_steps(const cmd_script_t * script, int loops, bool timing) {
+  uint32_t total= 0;
+  for( int loop=0; loop<loops; loop++ ) {
+    const char * lines= script->lines;
+    for( int i=0; i<script->count; i++ ) {
+      cmd_step_t step;
+      memcpy_P(&step, &script->steps[i], sizeof step);
+      // Copy the line to (scratch) RAM, since handlers may modify their arguments, and build argv (just as long as needed)
+      char * line= (char *)cmd_scratch_alloc( step.len+1 );
+      if( line==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); return total; }
+      memcpy_P(line, lines, step.len+1);
+      lines+= step.len+1;
+      int argc= 0;
+      for( char * p= line; *p!='\0'; p++ ) {
+        if( *p==' ' ) *p= '\0'; else if( p==line || p[-1]=='\0' ) argc++;
+      }
+      char ** argv= (char **)cmd_scratch_alloc( (argc>0 ? argc : 1)*sizeof(char *) ); // CMD_SCRIPT checked argc<=CMD_MAXARGS
+      if( argv==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); cmd_scratch_free(line); return total; }
+      argc= 0;
+      for( char * p= line; p<line+step.len; p++ ) {
+        if( *p!='\0' && (p==line || p[-1]=='\0') ) argv[argc++]= p;
+      }
+      // Run the step
+      cmd_outsync();
+      uint32_t t= micros();
+      CMD_PROF_CALL( cmd_prof_script, step.main(argc, argv) );
+      // A step that started a task is awaited (its time included): the next step may depend on it.
+      // There is no input while a script runs, so the task can not be cancelled.
+      // The wait yields, so that the background work of the core (e.g. WiFi and the watchdog on ESP8266) runs.
+      while( cmd_cur->taskfunc ) {
+        if( !cmd_cur->taskfunc(&cmd_cur->taskstate, false) ) cmd_cur->taskfunc= 0;
+        cmd_outdrain();
+        yield();
+      }
+      t= micros()-t;
+      total+= t;
+      if( timing ) { cmd_out.print(F("script: step ")); cmd_out.print(i); cmd_out.print(F(": ")); cmd_out.print(t); cmd_out.print(F(" us\n")); }
+      cmd_scratch_free(line); // Also frees argv
+    }
+  }
+  return total;
+}
+
+
+// Runs all steps of `script`, `loops` times (see cmd_script_steps); it may be called from setup() (a boot script).
+uint32_t cmd_script_run(const cmd_script_t * script, int loops, bool timing) {
+  CMD_SCRATCH_OPEN();
+  uint32_t total= cmd_script_steps(script, loops, timing);
+  CMD_SCRATCH_CLOSE();
+  return total;
+}
+
+
+// Subcommands =====================================================================
+
+
+// Returns the name of subcommand `ix` of the PROGMEM `subs`
+static const char * cmd_sub_name(const cmd_sub_t * subs, int ix) {
+  return (const char *)pgm_read_ptr(&subs[ix].name);
+}
+
+
+// Searches `name` in the sorted subcommands first..last-1 of `subs`; returns and reports as cmd_findin().
+static int cmd_sub_findin(const cmd_sub_t * subs, int first, int last, const char * name, int * ix, bool * exact) {
+  int lo= first;
+  int hi= last;
+  while( lo<hi ) {
+    int mid= (lo+hi)/2;
+    if( cmd_cmpprefix(cmd_sub_name(subs,mid),name)<0 ) lo= mid+1; else hi= mid;
+  }
+  *ix= lo;
+  if( lo==last || cmd_cmpprefix(cmd_sub_name(subs,lo),name)!=0 ) return 0; // not found
+  *exact= pgm_read_byte(cmd_sub_name(subs,lo)+strlen(name))=='\0';
+  return lo+1<last && cmd_cmpprefix(cmd_sub_name(subs,lo+1),name)==0 ? 2 : 1;
+}
+
+
+// Finds `word` (which may be abbreviated) in the PROGMEM `choices` ("off|on"). 
+// Returns the index of the choice, or -1 when not found or ambiguous.
+static int cmd_sub_choice(/*PROGMEM*/const char * choices, const char * word) {
+  int ix= 0, found= -1, count= 0;
+  const char * p= choices;
+  while( pgm_read_byte(p)!='\0' ) {
+    const char * w= word;
+    while( *w!='\0' && pgm_read_byte(p)==(byte)*w ) { p++; w++; }
+    byte b= pgm_read_byte(p);
+    if( *w=='\0' ) {
+      if( b=='|' || b=='\0' ) return ix; // exact match
+      found= ix;
+      count++;
+    }
+    while( b!='|' && b!='\0' ) b= pgm_read_byte(++p); // skip rest of choice
+    if( b=='|' ) p++;
+    ix++;
+  }
+  return count==1 ? found : -1;
+}
+
+
+// Prints the start of an error for (PROGMEM) subcommand `sub` of command `cmd`: "ERROR: cmd: sub: "
+static void cmd_sub_error(const char * cmd, /*PROGMEM*/const char * sub) {
+  cmd_out.print(F("ERROR: ")); 
+  cmd_out.print(cmd[0]=='@' ? cmd+1 : cmd); 
+  cmd_out.print(F(": ")); 
+  if( pgm_read_byte(sub)!='\0' ) { cmd_out.print(f(sub)); cmd_out.print(F(": ")); }
+}
+
+
+// Prints the argument `type` (for an error)
+static void cmd_sub_typeprint(char type, /*PROGMEM*/const char * choices) {
+  switch( type ) {
+    case 'd': cmd_out.print(F("<dec>")); break;
+    case 'h': cmd_out.print(F("<hex>")); break;
+#if CMD_HEX32
+    case 'H': cmd_out.print(F("<hex32>")); break;
+#endif
+    case 'e': cmd_out.print(F("'")); cmd_out.print(f(choices)); cmd_out.print(F("'")); break;
+    default : cmd_out.print(F("<word>")); break;
+  }
+}
+
+
+// Parses the arguments argv[a..argc-1] of subcommand `sub` into vals[]. Returns the number of values, 
+// or -1 when the arguments do not match; then an error is printed, unless `quiet`.
+static int cmd_sub_parse(int argc, char * argv[], int a, const cmd_sub_t * sub, cmd_val_t * vals, bool quiet) {
+  const char * t= sub->args;
+  bool optional= false;
+  int n= 0;
+  for(;;) {
+    char type= pgm_read_byte(t);
+    if( type=='[' ) { optional= true; t++; continue; }
+    if( type=='\0' ) {
+      if( a==argc ) break;
+      if( !quiet ) { cmd_sub_error(argv[0], sub->name); cmd_out.print(F("unexpected '")); cmd_out.print(argv[a]); cmd_out.print(F("'\n")); }
+      return -1;
+    }
+    bool repeat= pgm_read_byte(t+1)=='*';
+    if( a==argc ) {
+      if( optional || repeat ) break;
+      if( !quiet ) { cmd_sub_error(argv[0], sub->name); cmd_out.print(F("expected ")); cmd_sub_typeprint(type,sub->choices); cmd_out.print(F("\n")); }
+      return -1;
+    }
+    cmd_val_t * v= &vals[n];
+    bool ok= true;
+    switch( type ) {
+      case 'd': ok= cmd_parse_dec(argv[a],&v->dec); break;
+      case 'h': ok= cmd_parse_hex(argv[a],&v->hex16); break;
+#if CMD_HEX32
+      case 'H': ok= cmd_parse_hex32(argv[a],&v->hex32); break;
+#endif
+      case 'e': v->index= cmd_sub_choice(sub->choices,argv[a]); ok= v->index>=0; break;
+      case 's': v->str= argv[a]; break;
+      case 'r': 
+        // Join the remaining words (in place, they are in order in one buffer) with single spaces
+        v->str= argv[a]; 
+        for( char * d= argv[a]+strlen(argv[a]); ++a<argc; ) { *d++= ' '; size_t len= strlen(argv[a]); memmove(d,argv[a],len+1); d+= len; }
+        a= argc-1;
+        break;
+    }
+    if( !ok ) {
+      if( !quiet ) {
+        cmd_sub_error(argv[0], sub->name); cmd_out.print(F("expected ")); cmd_sub_typeprint(type,sub->choices); 
+        cmd_out.print(F(", not '")); cmd_out.print(argv[a]); cmd_out.print(F("'\n"));
+      }
+      return -1;
+    }
+    n++;
+    a++;
+    if( !repeat ) t++;
+  }
+  return n;
+}
+
+
+// Dispatches the command in argv to one of the `count` PROGMEM `subs` (sorted on name). 
+// Returns false (after printing an error) when there is no matching subcommand or the arguments do not match.
+// A one letter abbreviation selects the first subcommand with that letter. When an abbreviated subcommand 
+// does not get matching arguments, the line goes to the default (so "echo w" prints "w").
+bool cmd_dispatch(int argc, char * argv[], /*PROGMEM*/const cmd_sub_t * subs, int count) {
+  // Find the subcommand; the default (if any) is the first, it is not searched
+  int first= count>0 && pgm_read_byte(cmd_sub_name(subs,0))=='\0' ? 1 : 0;
+  int ix= 0, a= 1, n= 0;
+  bool exact= false;
+  if( argc>1 ) n= cmd_sub_findin(subs, first, count, argv[1], &ix, &exact);
+  if( n>1 && argv[1][1]=='\0' ) n= 1; // One letter: the first one
+  if( n==1 || exact ) {
+    a= 2; // argv[1] is the subcommand
+  } else if( n==0 && first==1 ) {
+    ix= 0; // default
+  } else {
+    cmd_out.print(F("ERROR: ")); 
+    cmd_out.print(argv[0][0]=='@' ? argv[0]+1 : argv[0]); 
+    if( argc==1 ) { cmd_out.print(F(": subcommand missing (try help)\n")); cmd_set_status(CMD_ERR_ARGS); return false; }
+    cmd_out.print(F(": subcommand '")); cmd_out.print(argv[1]); 
+    cmd_out.print(n>1 ? F("' ambiguous (try help)\n") : F("' not found (try help)\n")); 
+    cmd_set_status(CMD_ERR_ARGS);
+    return false;
+  }
+  cmd_sub_t sub;
+  memcpy_P(&sub, &subs[ix], sizeof sub);
+  // Parse the arguments: one value per argument
+  cmd_val_t * vals= (cmd_val_t *)cmd_scratch_alloc( (argc>1 ? argc-1 : 1)*sizeof(cmd_val_t) );
+  if( vals==0 ) { cmd_out.print(F("ERROR: out of scratch memory\n")); cmd_set_status(CMD_ERR_SCRATCH); return false; }
+  bool fallback= a==2 && !exact && first==1;
+  n= cmd_sub_parse(argc, argv, a, &sub, vals, fallback);
+  if( n<0 && fallback ) {
+    memcpy_P(&sub, &subs[0], sizeof sub);
+    n= cmd_sub_parse(argc, argv, 1, &sub, vals, false);
+  }
+  if( n<0 ) {
+    cmd_set_status(CMD_ERR_ARGS);
+    cmd_scratch_free(vals);
+    return false;
+  }
+  sub.func(argv, n, vals);
+  cmd_scratch_free(vals);
+  return true;
+}
+
+
+// Streaming statistics ============================================================
+
+
+#if CMD_STATS
+// The quantiles estimated by the sketches, as fraction of 65536 (50, 90 and 99 percent)
+static const uint16_t cmd_stats_q[CMD_STATS_QUANTILES] PROGMEM = { 32768, 58982, 64880 };
+static_assert( 3*CMD_STATS_QUANTILES>=5, "cmd_stats_t keeps the first 5 values in qh[]" );
+
+
+// Clears `stats`, and sets its histogram to bins of width 2^shift starting at lo.
+void cmd_stats_init(cmd_stats_t * stats, int32_t lo, uint8_t shift) {
+  stats->lo= lo;
+  stats->shift= shift;
+  cmd_stats_reset(stats);
+}
+
+
+// Clears `stats` (keeps the histogram bounds).
+void cmd_stats_reset(cmd_stats_t * stats) {
+  stats->count= 0;
+  stats->min= 0;
+  stats->max= 0;
+  stats->mean= 0;
+  stats->m2= 0;
+  memset(stats->bins, 0, sizeof stats->bins);
+  memset(stats->qh, 0, sizeof stats->qh);
+  memset(stats->qn, 0, sizeof stats->qn);
+}
+
+
+// Adds `val` to the P-square sketch of quantile `q` (count already includes `val`, min and max not yet).
+// The markers are min, h[0..2], max at positions 1, n[0..2], count. Each inner marker has a desired position, 
+// which moves with a fixed fraction per value; when a marker is one or more off, it moves one position, 
+// and its height is adjusted with a parabola through it and its neighbors (or linearly if that is not monotone).
+static void cmd_stats_psquare(cmd_stats_t * stats, int q, int32_t val) {
+  int32_t  * h= &stats->qh[3*q];
+  uint32_t * n= &stats->qn[3*q];
+  // Find the cell of val, and shift the positions of the markers above it
+  int32_t  H[5]= { val<stats->min ? val : stats->min, h[0], h[1], h[2], val>stats->max ? val : stats->max };
+  int k= 0;
+  while( k<3 && val>=H[k+1] ) k++;
+  for( int i=k; i<3; i++ ) n[i]++;
+  int64_t P[5]= { 1, n[0], n[1], n[2], stats->count };
+  // Adjust the inner markers
+  uint32_t p= pgm_read_word(&cmd_stats_q[q]);
+  uint32_t dn[3]= { p/2, p, (65536+p)/2 }; // Q16
+  for( int i=1; i<=3; i++ ) {
+    int64_t d= 65536 + (int64_t)(stats->count-1)*dn[i-1] - P[i]*65536; // desired minus actual position, Q16
+    if( (d>=65536 && P[i+1]-P[i]>1) || (d<=-65536 && P[i-1]-P[i]<-1) ) {
+      int s= d>0 ? 1 : -1;
+      int64_t hp= H[i] + s*( (P[i]-P[i-1]+s)*((int64_t)H[i+1]-H[i])/(P[i+1]-P[i]) + (P[i+1]-P[i]-s)*((int64_t)H[i]-H[i-1])/(P[i]-P[i-1]) )/(P[i+1]-P[i-1]);
+      if( H[i-1]<hp && hp<H[i+1] ) H[i]= hp; else H[i]+= s*((int64_t)H[i+s]-H[i])/(P[i+s]-P[i]);
+      P[i]+= s;
+    }
+  }
+  for( int i=0; i<3; i++ ) { h[i]= H[i+1]; n[i]= P[i+1]; }
+}
+
+
+// Adds `val` to `stats`; constant time.
+void cmd_stats_add(cmd_stats_t * stats, int32_t val) {
+  stats->count++;
+  // The quantile sketches; they start with the first 5 values (kept in qh)
+  if( stats->count<=5 ) {
+    stats->qh[stats->count-1]= val;
+    if( stats->count==5 ) {
+      int32_t s[5];
+      memcpy(s, stats->qh, sizeof s);
+      for( int i=1; i<5; i++ ) for( int j=i; j>0 && s[j-1]>s[j]; j-- ) { int32_t t= s[j]; s[j]= s[j-1]; s[j-1]= t; }
+      for( int q=0; q<CMD_STATS_QUANTILES; q++ ) for( int i=0; i<3; i++ ) { stats->qh[3*q+i]= s[i+1]; stats->qn[3*q+i]= i+2; }
+    }
+  } else {
+    for( int q=0; q<CMD_STATS_QUANTILES; q++ ) cmd_stats_psquare(stats, q, val);
+  }
+  // Min and max
+  if( stats->count==1 || val<stats->min ) stats->min= val;
+  if( stats->count==1 || val>stats->max ) stats->max= val;
+  // Welford: the mean moves delta/count towards the value, m2 grows with delta times the distance to the new mean
+  int64_t x= (int64_t)val*256;
+  int64_t delta= x-stats->mean;
+  stats->mean+= ( delta + (delta<0 ? -1 : 1)*(int64_t)(stats->count/2) )/(int64_t)stats->count; // rounded
+  stats->m2+= (uint64_t)delta*(uint64_t)(x-stats->mean)/256; // Both factors have the same sign (unsigned: no overflow trap)
+  // Histogram: the bin is clamped before narrowing (val-lo may exceed 31 bits)
+  int64_t bin= val<stats->lo ? 0 : ((int64_t)val-stats->lo)>>stats->shift;
+  if( bin>=CMD_STATS_BINS ) bin= CMD_STATS_BINS-1;
+  if( stats->bins[(int)bin]<UINT16_MAX ) stats->bins[(int)bin]++;
+}
+
+
+// Returns the estimate of quantile `q` (0, 1, 2 for the 50, 90 and 99 percentile) of `stats`.
+int32_t cmd_stats_quantile(const cmd_stats_t * stats, int q) {
+  if( stats->count==0 ) return 0;
+  if( stats->count>5 ) return stats->qh[3*q+1];
+  // At most 5 values: sort them, and take the nearest rank (with 5, the sketch has them sorted)
+  int32_t s[5]= { stats->min, stats->qh[0], stats->qh[1], stats->qh[2], stats->max };
+  int n= stats->count;
+  if( n<5 ) memcpy(s, stats->qh, n*sizeof s[0]);
+  for( int i=1; i<n; i++ ) for( int j=i; j>0 && s[j-1]>s[j]; j-- ) { int32_t t= s[j]; s[j]= s[j-1]; s[j-1]= t; }
+  return s[ ( (uint32_t)(n-1)*pgm_read_word(&cmd_stats_q[q]) + 32768 )/65536 ];
+}
+
+
+// Returns the variance of `stats` (times 256).
+uint64_t cmd_stats_variance(const cmd_stats_t * stats) {
+  return stats->count<2 ? 0 : stats->m2/(stats->count-1);
+}
+
+
+// Prints `stats` to cmd_out, prefixed with `name` (in PROGMEM); with `hist` also the histogram.
+void cmd_stats_print(const cmd_stats_t * stats, /*PROGMEM*/const char * name, bool hist) {
+  cmd_out.print(f(name)); cmd_out.print(F(": count ")); cmd_out.print(stats->count);
+  if( stats->count>0 ) {
+    cmd_out.print(F(", min ")); cmd_out.print(stats->min);
+    cmd_out.print(F(", max ")); cmd_out.print(stats->max);
+    cmd_out.print(F(", mean ")); cmd_out.print(stats->mean/256.0);
+    cmd_out.print(F(", stddev ")); cmd_out.print(sqrt(cmd_stats_variance(stats)/256.0));
+    cmd_out.print(F("\n")); 
+    cmd_out.print(f(name)); 
+    cmd_out.print(F(": p50 ~")); cmd_out.print(cmd_stats_quantile(stats,0));
+    cmd_out.print(F(", p90 ~")); cmd_out.print(cmd_stats_quantile(stats,1));
+    cmd_out.print(F(", p99 ~")); cmd_out.print(cmd_stats_quantile(stats,2));
+  }
+  cmd_out.print(F("\n")); 
+  if( !hist || stats->count==0 ) return;
+  // The histogram, with a bar scaled to the largest bin
+  uint16_t top= 1;
+  for( int i=0; i<CMD_STATS_BINS; i++ ) if( stats->bins[i]>top ) top= stats->bins[i];
+  for( int i=0; i<CMD_STATS_BINS; i++ ) {
+    int32_t lo= stats->lo + ((int32_t)i<<stats->shift);
+    cmd_out.print(f(name)); cmd_out.print(F(": "));
+    if( i>0 ) cmd_out.print(lo); 
+    cmd_out.print(F(".."));
+    if( i<CMD_STATS_BINS-1 ) cmd_out.print(lo+((int32_t)1<<stats->shift)-1); 
+    cmd_out.print(F(" ")); cmd_out.print(stats->bins[i]); cmd_out.print(F(" "));
+    for( int n= (int)((uint32_t)stats->bins[i]*32/top); n>0; n-- ) cmd_out.print('#');
+    cmd_out.print(F("\n")); 
+  }
+}
+#endif
+
+
+// Helpers =========================================================================
+
+
+void cmd_set_streamfunc(cmd_func_t func) {
+  cmd_cur->streamfunc= func;
+}
+
+
+cmd_func_t cmd_get_streamfunc(void) {
+  return cmd_cur->streamfunc;
+}
+
+
+void cmd_set_streamrawfunc(cmd_rawfunc_t func) {
+  cmd_cur->streamrawfunc= func;
+}
+
+
+cmd_rawfunc_t cmd_get_streamrawfunc(void) {
+  return cmd_cur->streamrawfunc;
+}
+
+
+#if CMD_STREAMPROMPT
+void cmd_set_streamprompt(const char * prompt) {
+  if( cmd_cur->promptsize==0 ) return; // Not initialized
+  strncpy(cmd_cur->streamprompt, prompt, cmd_cur->promptsize);
+  cmd_cur->streamprompt[cmd_cur->promptsize-1]= '\0';
+}
+
+
+void cmd_set_streampromptf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  if( cmd_cur->promptsize>0 ) vsnprintf(cmd_cur->streamprompt, cmd_cur->promptsize, format, args);
+  va_end(args);
+}
+
+
+const char * cmd_get_streamprompt(void) {
+  return cmd_cur->streamprompt;
+}
+#endif
+
+
+#if CMD_BINARY
+void cmd_set_binfunc(cmd_binfunc_t func) {
+  cmd_cur->binfunc= func;
+  cmd_cur->bin_rem= 0;
+  cmd_cur->bin_zero= false;
+  cmd_cur->bin_bad= false;
+  cmd_cur->bin_lf= false;
+}
+
+
+cmd_binfunc_t cmd_get_binfunc(void) {
+  return cmd_cur->binfunc;
+}
+
+
+// Returns the CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of `len` bytes at `data`.
+uint16_t cmd_crc16(const uint8_t * data, int len) {
+  uint16_t crc= 0xFFFF;
+  while( len-- > 0 ) {
+    crc^= (uint16_t)(*data++) << 8;
+    for( int i=0; i<8; i++ ) crc= (crc & 0x8000) ? (crc<<1) ^ 0x1021 : crc<<1;
+  }
+  return crc;
 }
+#endif
 
 
-// Helpers =========================================================================
+// SWAR (SIMD within a register) helpers for the parse functions. 
+// A word holds 4 chars, the first char in the lowest byte; all bytes are processed in parallel.
+#define CMD_SWAR_ONES 0x01010101UL
+#define CMD_SWAR_HIGH 0x80808080UL
 
 
-void cmd_set_streamfunc(cmd_func_t func) {
-  cmd_streamfunc= func;
+// Loads the `len` (at most 4) chars at `s` in a word, right aligned and padded with '0's
+static uint32_t cmd_swar_load(const char * s, int len) {
+  uint8_t b[4]= {'0','0','0','0'};
+  memcpy(b+4-len, s, len);
+  return b[0] | (uint32_t)b[1]<<8 | (uint32_t)b[2]<<16 | (uint32_t)b[3]<<24;
 }
 
 
-cmd_func_t cmd_get_streamfunc(void) {
-  return cmd_streamfunc;
+// Returns a word with bit 7 set in each byte of `w` that lies in [lo,hi] (the bytes of `w` must be below 0x80)
+static uint32_t cmd_swar_inrange(uint32_t w, uint8_t lo, uint8_t hi) {
+  return (w + CMD_SWAR_ONES*(0x80-lo)) & ~(w + CMD_SWAR_ONES*(0x7F-hi)) & CMD_SWAR_HIGH;
 }
 
 
-void cmd_set_streamprompt(const char * prompt) {
-  strncpy(cmd_streamprompt, prompt, CMD_PROMPT_SIZE);
-  cmd_streamprompt[CMD_PROMPT_SIZE-1]= '\0';
+// Converts a word of 4 hex chars to its value. Returns false if a char is not a hex digit.
+static bool cmd_swar_hex(uint32_t w, uint16_t * v) {
+  if( w & CMD_SWAR_HIGH ) return false;
+  uint32_t digit= cmd_swar_inrange(w,'0','9');
+  uint32_t alpha= cmd_swar_inrange(w|0x20202020UL,'a','f'); // Lower case
+  if( (digit|alpha)!=CMD_SWAR_HIGH ) return false;
+  uint32_t n= (w & 0x0F0F0F0FUL) + (alpha>>7)*9;         // The value of each digit, one per byte
+  n= ((n & 0x000F000FUL) << 4) | ((n >> 8) & 0x000F000FUL); // Two digits per byte, in byte 0 and 2
+  *v= (uint16_t)( ((n & 0xFF) << 8) | (n >> 16) );
+  return true;
 }
 
 
-void cmd_set_streampromptf(const char *format, ...) {
-  va_list args;
-  va_start(args, format);
-  vsnprintf(cmd_streamprompt, CMD_PROMPT_SIZE, format, args);
-  va_end(args);
+// Converts a word of 4 decimal chars to its value. Returns false if a char is not a decimal digit.
+static bool cmd_swar_dec(uint32_t w, uint16_t * v) {
+  if( w & CMD_SWAR_HIGH ) return false;
+  if( cmd_swar_inrange(w,'0','9')!=CMD_SWAR_HIGH ) return false;
+  w-= CMD_SWAR_ONES*'0';                     // The value of each digit, one per byte
+  w= (w*10 + (w>>8)) & 0x00FF00FFUL;         // Two digits per 16 bit lane
+  *v= (uint16_t)( (w*100 + (w>>16)) & 0xFFFF ); // Four digits
+  return true;
 }
 
 
-const char * cmd_get_streamprompt(void) {
-  return cmd_streamprompt;
+// Returns the length of `s`, but stops counting after `max`+1 (so that a caller can detect "too long")
+static int cmd_strlen_max(const char * s, int max) {
+  int len= 0;
+  while( len<=max && s[len]!='\0' ) len++;
+  return len;
 }
 
 
@@ -216,18 +1678,13 @@ bool cmd_parse_hex(const char*s,uint16_t*v) {
   if( s==0 ) return false; // no string: not ok
   if( *s==0 ) return false; // empty string: not ok
   while( *s=='0' ) s++; // strip leading 0's
-  if( strlen(s)>4 ) return false;
-  while( *s!=0 ) {
-    if     ( '0'<=*s && *s<='9' ) *v = (*v)*16 + *s - '0';
-    else if( 'a'<=*s && *s<='f' ) *v = (*v)*16 + *s - 'a' + 10;
-    else if( 'A'<=*s && *s<='F' ) *v = (*v)*16 + *s - 'A' + 10;
-    else return false;
-    s++;
-  }
-  return true;
+  int len= cmd_strlen_max(s,4);
+  if( len>4 ) return false;
+  return cmd_swar_hex(cmd_swar_load(s,len),v);
 }
 
 
+#if CMD_HEX32
 // Parse a string of a hex number ("F1110A8F"), returns false if there were errors. 
 // If true is returned, *v is the parsed value.
 bool cmd_parse_hex32(const char*s,uint32_t*v) {
@@ -236,19 +1693,20 @@ bool cmd_parse_hex32(const char*s,uint32_t*v) {
   if( s==0 ) return false; // no string: not ok
   if( *s==0 ) return false; // empty string: not ok
   while( *s=='0' ) s++; // strip leading 0's
-  if( strlen(s)>8 ) return false;
-  while( *s!=0 ) {
-    if     ( '0'<=*s && *s<='9' ) *v = (*v)*16 + *s - '0';
-    else if( 'a'<=*s && *s<='f' ) *v = (*v)*16 + *s - 'a' + 10;
-    else if( 'A'<=*s && *s<='F' ) *v = (*v)*16 + *s - 'A' + 10;
-    else return false;
-    s++;
-  }
+  int len= cmd_strlen_max(s,8);
+  if( len>8 ) return false;
+  // Parse in two halves of (at most) 4 digits
+  int n= len>4 ? len-4 : 0;
+  uint16_t hi, lo;
+  if( !cmd_swar_hex(cmd_swar_load(s,n),&hi) ) return false;
+  if( !cmd_swar_hex(cmd_swar_load(s+n,len-n),&lo) ) return false;
+  *v= (uint32_t)hi<<16 | lo;
   return true;
 }
+#endif
 
 
-// Parse a string of a decimal number ("-12"), returns false if there were errors. 
+// Parse a string of a decimal number ("-12"), returns false if there were errors (including overflow). 
 // If true is returned, *v is the parsed value.
 bool cmd_parse_dec(const char*s,int*v) {
   if( v==0 ) return false; 
@@ -265,18 +1723,55 @@ bool cmd_parse_dec(const char*s,int*v) {
   }
   if( *s==0 ) return false; // empty string after sign: not ok
   while( *s=='0' ) s++; // strip leading 0's
-  while( *s!=0 ) {
-    if( *s<'0' || '9'<*s ) return false;
-    int vv= (*v)*10 + *s - '0';
-    if( vv<*v ) return false; // overflow
-    *v = vv;
-    s++;
+  // Parse in groups of 4 digits (the first group has the remainder), checking overflow before each step
+  unsigned long limit= sign<0 ? (unsigned long)INT_MAX+1 : (unsigned long)INT_MAX;
+  unsigned long val= 0;
+  int len= cmd_strlen_max(s,12); // An int has at most 10 digits
+  int n= len - 4*((len-1)/4);
+  while( len>0 ) {
+    uint16_t group;
+    if( !cmd_swar_dec(cmd_swar_load(s,n),&group) ) return false;
+    if( val > (limit-group)/10000 ) return false; // overflow
+    val= val*10000 + group;
+    s+= n;
+    len-= n;
+    n= 4;
   }
-  *v *= sign;
+  if( *s!=0 ) return false; // longer than cmd_strlen_max() scanned: overflow
+  *v= sign<0 ? -(int)(val-1)-1 : (int)val; // Written so that INT_MIN does not overflow
   return true;
 }
 
 
+// Parses argv[0..argc-1] as hex numbers (see cmd_parse_hex) into vals[0..argc-1].
+// Returns the number of parsed tokens; if that is less than argc, it is the index of the first bad token.
+int cmd_parse_hex_array(int argc, char * argv[], uint16_t * vals) {
+  int i= 0;
+  while( i<argc && cmd_parse_hex(argv[i],&vals[i]) ) i++;
+  return i;
+}
+
+
+#if CMD_HEX32
+// Parses argv[0..argc-1] as hex numbers (see cmd_parse_hex32) into vals[0..argc-1].
+// Returns the number of parsed tokens; if that is less than argc, it is the index of the first bad token.
+int cmd_parse_hex32_array(int argc, char * argv[], uint32_t * vals) {
+  int i= 0;
+  while( i<argc && cmd_parse_hex32(argv[i],&vals[i]) ) i++;
+  return i;
+}
+#endif
+
+
+// Parses argv[0..argc-1] as decimal numbers (see cmd_parse_dec) into vals[0..argc-1].
+// Returns the number of parsed tokens; if that is less than argc, it is the index of the first bad token.
+int cmd_parse_dec_array(int argc, char * argv[], int * vals) {
+  int i= 0;
+  while( i<argc && cmd_parse_dec(argv[i],&vals[i]) ) i++;
+  return i;
+}
+
+
 // Returns true iff `prefix` is a prefix of `str`. Note `str` must be in PROGMEM (and `prefix` in RAM)
 bool cmd_isprefix(const char *str, const char *prefix) {
   while( *prefix!='\0') {
@@ -289,127 +1784,620 @@ bool cmd_isprefix(const char *str, const char *prefix) {
 }
 
 
-// A (formatting) printf towards Serial
+#if defined(__AVR__)
+// On AVR, printf formats char by char into a stdio stream; the chars go straight to the output queue (no buffer, no length limit)
+static int cmd_printf_putc(char ch, FILE * stream) {
+  (void)stream;
+  cmd_out.write((uint8_t)ch);
+  return 0;
+}
+#else
+// Elsewhere, printf formats into the free part of the scratch arena. When the output is longer, it is printed piece by piece:
+// the text between the conversions directly, and each conversion formatted alone into that part (no heap, no length limit).
+
+// Reads char `ix` of `format` (which is in PROGMEM when `progmem`)
+static char cmd_fmtchar(bool progmem, const char * format, int ix) {
+  return progmem ? (char)pgm_read_byte(format+ix) : format[ix];
+}
+
+
+// Prints the (PROGMEM when `progmem`) string `str` padded to `width` (left aligned when `left`), at most `prec` chars when prec>=0
+static int cmd_vprintf_str(bool progmem, const char * str, int width, int prec, bool left) {
+  if( str==0 ) { str= "(null)"; progmem= false; }
+  int len= 0;
+  while( (prec<0 || len<prec) && cmd_fmtchar(progmem,str,len)!='\0' ) len++;
+  int pad= width>len ? width-len : 0;
+  for( int i=0; !left && i<pad; i++ ) cmd_out.write(' ');
+  if( progmem ) for( int i=0; i<len; i++ ) cmd_out.write((uint8_t)cmd_fmtchar(true,str,i)); else cmd_out.write(str, len);
+  for( int i=0; left && i<pad; i++ ) cmd_out.write(' ');
+  return len+pad;
+}
+
+
+// Prints `format` with the arguments `ap` piece by piece, using `buf` of `size` bytes per conversion. Returns the number of chars.
+// A %S argument is a PROGMEM string (as for cmd_printf_P); a single conversion longer than buf is truncated.
+static int cmd_vprintf_pieces(bool progmem, const char * format, va_list * ap, char * buf, int size) {
+  int count= 0;
+  char spec[16];
+  while( cmd_fmtchar(progmem,format,0)!='\0' ) {
+    // Text up to the next conversion
+    int n= 0;
+    while( cmd_fmtchar(progmem,format,n)!='\0' && cmd_fmtchar(progmem,format,n)!='%' ) n++;
+    if( n>0 ) { cmd_vprintf_str(progmem, format, 0, n, false); count+= n; format+= n; continue; }
+    // The conversion: % flags width .precision length type; a '*' takes an int argument
+    int stars[2], nstars= 0, width= 0, prec= -1, len= 0;
+    bool left= false, dot= false;
+    char ch, length= ' ';
+    spec[len++]= '%';
+    format++;
+    while( (ch=cmd_fmtchar(progmem,format,0))!='\0' ) {
+      format++;
+      if( len<(int)sizeof spec-2 ) spec[len++]= ch;
+      if( ch=='-' ) left= true;
+      else if( ch=='.' ) { dot= true; prec= 0; }
+      else if( ch=='*' ) { int v= va_arg(*ap, int); if( nstars<2 ) stars[nstars++]= v; if( dot ) prec= v<0 ? -1 : v; else { width= v<0 ? -v : v; left|= v<0; } }
+      else if( ch>='0' && ch<='9' ) { if( dot ) prec= prec*10+ch-'0'; else if( ch!='0' || width>0 ) width= width*10+ch-'0'; }
+      else if( ch=='h' || ch=='l' || ch=='j' || ch=='z' || ch=='t' || ch=='L' ) length= length==ch ? (char)(ch-32) : ch; // hh->H, ll->L
+      else if( strchr("+ #'", ch)==0 ) break;
+    }
+    spec[len]= '\0';
+    int res= 0;
+    #define CMD_VPRINTF_ARG(T) do { T v= va_arg(*ap, T); \
+      res= nstars==0 ? snprintf(buf,size,spec,v) : nstars==1 ? snprintf(buf,size,spec,stars[0],v) : snprintf(buf,size,spec,stars[0],stars[1],v); } while(0)
+    switch( ch ) {
+      case 'd': case 'i':
+        if( length=='l' ) CMD_VPRINTF_ARG(long); else if( length=='L' ) CMD_VPRINTF_ARG(long long); 
+        else if( length=='j' ) CMD_VPRINTF_ARG(intmax_t); else if( length=='z' || length=='t' ) CMD_VPRINTF_ARG(ptrdiff_t); 
+        else CMD_VPRINTF_ARG(int);
+        break;
+      case 'o': case 'u': case 'x': case 'X':
+        if( length=='l' ) CMD_VPRINTF_ARG(unsigned long); else if( length=='L' ) CMD_VPRINTF_ARG(unsigned long long); 
+        else if( length=='j' ) CMD_VPRINTF_ARG(uintmax_t); else if( length=='z' || length=='t' ) CMD_VPRINTF_ARG(size_t); 
+        else CMD_VPRINTF_ARG(unsigned);
+        break;
+      case 'c': CMD_VPRINTF_ARG(int); break;
+      case 'p': CMD_VPRINTF_ARG(void *); break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        if( length=='L' ) CMD_VPRINTF_ARG(long double); else CMD_VPRINTF_ARG(double);
+        break;
+      case 's': case 'S': count+= cmd_vprintf_str(ch=='S', va_arg(*ap, const char *), width, prec, left); continue;
+      case 'n': *va_arg(*ap, int *)= count; continue;
+      case '%': cmd_out.write('%'); count++; continue;
+      default : cmd_out.write(spec, len); count+= len; continue; // Unknown: printed as is
+    }
+    #undef CMD_VPRINTF_ARG
+    if( res>0 ) { cmd_out.write(buf, res<size ? res : size-1); count+= res; }
+  }
+  return count;
+}
+
+
+// Returns true iff `format` has a %S conversion. For vsnprintf that is a wide string, for cmd_printf a PROGMEM string.
+static bool cmd_vprintf_hasS(bool progmem, const char * format) {
+  for( int i=0; cmd_fmtchar(progmem,format,i)!='\0'; i++ ) {
+    if( cmd_fmtchar(progmem,format,i)!='%' ) continue;
+    i++;
+    while( cmd_fmtchar(progmem,format,i)!='\0' && strchr("-+ #'0123456789.*hljztL",cmd_fmtchar(progmem,format,i))!=0 ) i++;
+    if( cmd_fmtchar(progmem,format,i)=='S' ) return true;
+    if( cmd_fmtchar(progmem,format,i)=='\0' ) return false;
+  }
+  return false;
+}
+
+
+// Formats into the free scratch memory, and prints that. When the output does not fit, or when it has a %S 
+// (which vsnprintf does not take as PROGMEM string), it is printed piece by piece.
+static int cmd_vprintf(bool progmem, const char *format, va_list args) {
+  int size= cmd_scratch_avail();
+  char * buf= (char *)cmd_scratch_alloc(size);
+  va_list args2;
+  va_copy(args2, args);
+  int result= -1;
+  if( !cmd_vprintf_hasS(progmem, format) ) result= progmem ? vsnprintf_P(buf, size, format, args) : vsnprintf(buf, size, format, args);
+  if( result>=0 && result<size ) {
+    cmd_out.write(buf, result);
+  } else {
+    char local[32]; // Enough for a number, when scratch is (almost) used up
+    result= size<(int)sizeof local ? cmd_vprintf_pieces(progmem, format, &args2, local, sizeof local) : cmd_vprintf_pieces(progmem, format, &args2, buf, size);
+  }
+  cmd_scratch_free(buf);
+  va_end(args2);
+  return result;
+}
+#endif
+
+
+// A (formatting) printf towards cmd_out
 // Note: to print string from PROGMEM use %S (capital S), and PSTR for the string (but F also works)
 //   cmd_printf( "%S/%S\n", PSTR("foo"), F("bar") );
-static char cmd_printf_buf[CMD_PRT_SIZE];
 int cmd_printf(const char *format, ...) {
   va_list args;
   va_start(args, format);
-  int result = vsnprintf(cmd_printf_buf, CMD_PRT_SIZE, format, args);
-  Serial.print(cmd_printf_buf);
-  if( result>=CMD_PRT_SIZE ) Serial.print(F("\nOVERFLOW\n"));
+  #if defined(__AVR__)
+    FILE stream;
+    fdev_setup_stream(&stream, cmd_printf_putc, NULL, _FDEV_SETUP_WRITE);
+    int result = vfprintf(&stream, format, args);
+  #else
+    int result = cmd_vprintf(false, format, args);
+  #endif
   va_end(args);
   return result;
 }
 
 
-// A (formatting) printf towards Serial (the format string is in PROGMEM)
+// A (formatting) printf towards cmd_out (the format string is in PROGMEM)
 // Note: to print string from PROGMEM use %S (capital S), and PSTR for the string (but F also works). Format string must be PSTR()
 //   cmd_printf_P( PSTR("%S/%S\n"), PSTR("foo"), F("bar") );
+#if CMD_PRINTF_P
 int cmd_printf_P(/*PROGMEM*/const char *format, ...) {
   va_list args;
   va_start(args, format);
-  int result = vsnprintf_P(cmd_printf_buf, CMD_PRT_SIZE, format, args);
-  Serial.print(cmd_printf_buf);
-  if( result>=CMD_PRT_SIZE ) Serial.print(F("\nOVERFLOW\n"));
+  #if defined(__AVR__)
+    FILE stream;
+    fdev_setup_stream(&stream, cmd_printf_putc, NULL, _FDEV_SETUP_WRITE);
+    int result = vfprintf_P(&stream, format, args);
+  #else
+    int result = cmd_vprintf(true, format, args);
+  #endif
   va_end(args);
   return result;
 }
+#endif
 
 
 // Steps the cmd error counter (observable via 'echo error')
-static int cmd_errorcount= 0;
 void cmd_steperrorcount( void ) {
-  cmd_errorcount++;
+  cmd_cur->errorcount++;
 }
 
 
 // Returns and clears the cmd error counter
 int cmd_geterrorcount( void ) {
-  int current= cmd_errorcount;
-  cmd_errorcount= 0;
+  int current= cmd_cur->errorcount;
+  cmd_cur->errorcount= 0;
   return current;
 }
 
 
-// Check Serial for incoming chars, and feeds them to the command handler.
+// Check the stream of instance `cmd` for incoming chars, and feeds them to the command handler (with `cmd` current).
+// Chars are read in chunks of (at most) CMD_POLLSIZE and fed with cmd_addbuf().
 // Flags buffer overflows via cmd_steperrorcount() - observable via 'echo error'
-void cmd_pollserial( void ) {
-  // Check incoming serial chars
+// Also drains the output queue (without blocking).
+void cmd_poll( cmd_t * cmd ) {
+  cmd_t * prev= cmd_select(cmd);
+  CMD_SCRATCH_OPEN();
+  cmd_outdrain();
+  // Check incoming chars
+  Stream * stream= cmd_stream();
   int n= 0; // Counts number of bytes read, this is roughly the number of bytes in the UART buffer
-  while( 1 ) {
-    int ch= Serial.read();
-    if( ch==-1 ) break;
+  int avail= 0;
+  char * buf= (char *)cmd_scratch_alloc(CMD_POLLSIZE); // Only fails when polling from a command
+  while( buf!=0 ) {
+    avail= cmd_flowlevel( stream->available() );
+    if( avail<=0 ) break;
+    // Only read what fits (type-ahead of a task), the rest waits in the stream (and flow control stops the sender)
+    int size= cmd_feedroom(cmd);
+    if( size==0 ) {
+      if( stream->peek()!=CMD_CANCEL ) break;
+      stream->read();
+      cmd_add(CMD_CANCEL);
+      continue;
+    }
+    // Only read what is available, so that readBytes() does not wait for its timeout
+    if( size>avail ) size= avail;
+    int len= stream->readBytes(buf, size<CMD_POLLSIZE ? size : CMD_POLLSIZE);
+    if( len<=0 ) break;
+    n+= len;
     if( 
 #if defined(ESP8266) // #warning ESP8266
-        Serial.hasOverrun()
-#elif defined(ESP32) // #warning ESP32
-        ++n==256 // Hack; default RC buffer size is 256, see HardwareSerial.cpp line 55: _uart = uartBegin(...256...);
-#else // #warning AVR
-        ++n==SERIAL_RX_BUFFER_SIZE // Possible UART buffer overrun
+        ( stream==&Serial && Serial.hasOverrun() ) ||
 #endif
+        ( cmd->rxsize>0 && n>=cmd->rxsize && n-len<cmd->rxsize ) // Possible UART buffer overrun
     ) {
       cmd_steperrorcount();
-      Serial.print( F("\nWARNING: serial overflow\n") ); 
+      CMD_PROF_STEP(overflows,1);
+      cmd_out.print( F("\nWARNING: serial overflow\n") ); 
     }
-    // Process read char by feeding it to command interpreter
-    cmd_add(ch);
+    // Process read chars by feeding them to command interpreter
+    cmd_addbuf(buf, len);
   }
+  cmd_scratch_free(buf);
+  cmd_flowdrained(avail);
+  cmd_steptask();
+  cmd_outdrain();
+  CMD_SCRATCH_CLOSE();
+  cmd_select(prev);
+}
+
+
+// Check Serial for incoming chars, and feeds them to the command handler (the default instance)
+void cmd_pollserial( void ) {
+  cmd_poll(&cmd_serial);
 }
 
 
+// The receive ring ================================================================
 
-// Friend command: echo ================================================================
+
+#if (CMD_RXSIZE & (CMD_RXSIZE-1)) != 0
+#error CMD_RXSIZE must be a power of 2
+#endif
 
 
-// The handler for the "echo" command
-static void cmdecho_print() { Serial.print(F("echo: echoing ")); Serial.print(cmd_echo?F("enabled"):F("disabled")); Serial.print(F("\n")); }
-static void cmdecho_main(int argc, char * argv[]) {
-  if( argc==1 ) {
-    cmdecho_print();
-    return;
+// Initializes receive ring `rx` (empty, no overruns).
+void cmd_rx_init( cmd_rx_t * rx ) {
+  memset(rx, 0, sizeof *rx);
+}
+
+
+// Producer side: appends `ch` to `rx`. Returns false (and counts an overrun) when the ring is full.
+// Only the producer writes `head` and `overruns`; `tail` is only read, with acquire to see the consumer's progress.
+bool cmd_rx_put( cmd_rx_t * rx, uint8_t ch ) {
+  cmd_rxix_t head= rx->head;
+  cmd_rxix_t tail= __atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE);
+  if( (cmd_rxix_t)(head-tail)==CMD_RXSIZE ) {
+    __atomic_store_n(&rx->overruns, (uint16_t)(rx->overruns+1), __ATOMIC_RELAXED);
+    return false;
   }
-  if( argc==3 && cmd_isprefix(PSTR("faults"),argv[1]) && cmd_isprefix(PSTR("step"),argv[2]) ) {
+  rx->buf[head%CMD_RXSIZE]= ch;
+  __atomic_store_n(&rx->head, (cmd_rxix_t)(head+1), __ATOMIC_RELEASE); // Publish the byte
+  return true;
+}
+
+
+// Producer side: appends `len` bytes to `rx` (e.g. from a DMA callback). Returns the number of bytes appended;
+// the others are counted as overruns.
+int cmd_rx_putbuf( cmd_rx_t * rx, const uint8_t * buf, int len ) {
+  int n= 0;
+  while( n<len && cmd_rx_put(rx,buf[n]) ) n++;
+  if( n<len ) __atomic_store_n(&rx->overruns, (uint16_t)(rx->overruns+len-n-1), __ATOMIC_RELAXED); // cmd_rx_put() counted one
+  return n;
+}
+
+
+// Producer side: returns the number of bytes that can be put without overrun (the consumer may free more meanwhile).
+int cmd_rx_room( cmd_rx_t * rx ) {
+  return CMD_RXSIZE - (cmd_rxix_t)(rx->head-__atomic_load_n(&rx->tail, __ATOMIC_ACQUIRE));
+}
+
+
+// Consumer side: feeds all chars in `rx` to instance `cmd` (with `cmd` as current instance); lines execute here.
+// Overruns (bytes the producer had to drop) are counted with cmd_steperrorcount() and reported.
+void cmd_rx_poll( cmd_t * cmd, cmd_rx_t * rx ) {
+  cmd_t * prev= cmd_select(cmd);
+  CMD_SCRATCH_OPEN();
+  cmd_outdrain();
+  // Report overruns since last poll
+  uint16_t overruns= __atomic_load_n(&rx->overruns, __ATOMIC_RELAXED);
+  if( overruns!=rx->overruns_seen ) {
     cmd_steperrorcount();
-    if( argv[0][0]!='@') Serial.print(F("echo: faults: stepped\n")); 
-    return;
+    CMD_PROF_STEP(overflows,1);
+    cmd_out.print( F("\nWARNING: serial overflow (") ); 
+    cmd_out.print( (uint16_t)(overruns-rx->overruns_seen) ); 
+    cmd_out.print( F(" bytes lost)\n") ); 
+    rx->overruns_seen= overruns;
   }
-  if( argc==2 && cmd_isprefix(PSTR("faults"),argv[1]) ) {
-    int n= cmd_geterrorcount();
-    if( argv[0][0]!='@') { Serial.print(F("echo: faults: ")); Serial.print(n); Serial.print(F("\n")); }
-    return;
+  // Feed the received chars, in contiguous chunks of at most what fits (type-ahead of a task), the rest stays in the ring
+  cmd_rxix_t tail= rx->tail;
+  cmd_rxix_t head= __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE);
+  cmd_flowlevel( (cmd_rxix_t)(head-tail) );
+  while( tail!=head ) {
+    int ix= tail%CMD_RXSIZE;
+    int size= CMD_RXSIZE-ix;
+    if( size>(cmd_rxix_t)(head-tail) ) size= (cmd_rxix_t)(head-tail);
+    int room= cmd_feedroom(cmd);
+    if( room==0 && rx->buf[ix]==CMD_CANCEL ) room= 1; // Cancel is not held back
+    if( room==0 ) break;
+    if( size>room ) size= room;
+    cmd_addbuf((const char *)&rx->buf[ix], size);
+    tail+= size;
+    __atomic_store_n(&rx->tail, tail, __ATOMIC_RELEASE); // Hand the space back to the producer
+    head= __atomic_load_n(&rx->head, __ATOMIC_ACQUIRE);
+    cmd_flowlevel( (cmd_rxix_t)(head-tail) );
   }
-  if( argc==2 && cmd_isprefix(PSTR("enabled"),argv[1]) ) {
-    cmd_echo= true;
-    if( argv[0][0]!='@') cmdecho_print();
-    return;
+  cmd_flowdrained( (cmd_rxix_t)(head-tail) );
+  cmd_steptask();
+  cmd_outdrain();
+  CMD_SCRATCH_CLOSE();
+  cmd_select(prev);
+}
+
+
+// Event-driven input =============================================================
+
+
+// Feeds `len` received bytes to instance `cmd` (with `cmd` current); lines execute here. 
+// Also steps the task and drains the output queue.
+void cmd_feed( cmd_t * cmd, const char * buf, int len ) {
+  cmd_t * prev= cmd_select(cmd);
+  CMD_SCRATCH_OPEN();
+#if CMD_STATS
+  cmd->wakeus= micros();
+  cmd->waking= true;
+#endif
+  cmd_outdrain();
+  if( len>0 ) cmd_addbuf(buf, len);
+#if CMD_STATS
+  cmd->waking= false;
+#endif
+  cmd_steptask();
+  cmd_outdrain();
+  CMD_SCRATCH_CLOSE();
+  cmd_select(prev);
+}
+
+
+// Returns how many bytes `cmd` takes without losing any. While a task runs, that is the room left for type-ahead
+// (possibly 0); otherwise it is at least 1 (a too long line loses chars anyway). Feeding at most that many bytes 
+// at once also guarantees that the chars after a line that starts a task fit in the type-ahead.
+int cmd_feedroom( cmd_t * cmd ) {
+#if CMD_BINARY
+  if( cmd->binfunc ) return CMD_POLLSIZE; // Binary mode has no type-ahead
+#endif
+  int room= cmd->bufsize-1-cmd->ix;
+  if( cmd->taskfunc ) return room;
+  return room>0 ? room : 1;
+}
+
+
+// Returns how long (ms) the driver of `cmd` may sleep without input: -1 for "until input arrives".
+int cmd_waitms( cmd_t * cmd ) {
+  return cmd->taskfunc!=0 || cmd->outlen>0 ? CMD_FEED_TICKMS : -1;
+}
+
+
+#if CMD_STATS
+// Makes `cmd` record in `stats` the latency (us) from entering cmd_feed() to the execution of each line.
+void cmd_set_wakestats( cmd_t * cmd, cmd_stats_t * stats ) {
+  cmd->wakestats= stats;
+}
+
+
+// Returns the latency statistics of the current instance (0 if not set).
+cmd_stats_t * cmd_get_wakestats( void ) {
+  return cmd_cur->wakestats;
+}
+#endif
+
+
+// Returns the total number of bytes `rx` had to drop because it was full.
+uint16_t cmd_rx_overruns( cmd_rx_t * rx ) {
+  return __atomic_load_n(&rx->overruns, __ATOMIC_RELAXED);
+}
+
+
+// Submission queue ================================================================
+
+
+#if CMD_SUBMIT
+
+
+#if (CMD_SUBQ_SIZE & (CMD_SUBQ_SIZE-1)) != 0
+#error CMD_SUBQ_SIZE must be a power of 2
+#endif
+
+
+// Appends output of the instance of a submission queue to the running submission (interpreter task only).
+size_t cmd_capture_t::write(const uint8_t * buf, size_t size) {
+  if( sub==0 ) return size; // Nothing running (e.g. the message of cmd_init)
+  for( size_t i=0; i<size; i++, sub->outlen++ ) {
+    if( sub->outlen<sub->outsize-1 ) sub->out[sub->outlen]= buf[i];
   }
-  if( argc==2 && cmd_isprefix(PSTR("disabled"),argv[1]) ) {
-    cmd_echo= false;
-    if( argv[0][0]!='@') cmdecho_print();
-    return;
+  return size;
+}
+
+
+// Initializes submission queue `q` (empty), with `cmd` (with the buffers of `cfg`) as its instance.
+void cmd_subq_init( cmd_subq_t * q, cmd_t * cmd, const cmd_cfg_t * cfg ) {
+  for( int i=0; i<CMD_SUBQ_SIZE; i++ ) { q->slots[i]= 0; q->seqs[i]= i; }
+  q->tail= 0;
+  q->head= 0;
+  q->cur= 0;
+  q->cmd= cmd;
+  q->capture.sub= 0;
+  cmd_init(cmd, &q->capture, 0, cfg);
+  cmd->captured= true;
+}
+
+
+// Producer side (any task): enqueues `sub`. Returns false when the queue is full.
+// The ticket is the slot: it is taken with a compare-and-swap on `tail`, when the slot is free for it.
+bool cmd_submit( cmd_subq_t * q, cmd_submit_t * sub ) {
+  sub->outlen= 0;
+  sub->status= CMD_OK;
+  sub->done= 0;
+  uint32_t tail= __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+  for(;;) {
+    uint32_t seq= __atomic_load_n(&q->seqs[tail%CMD_SUBQ_SIZE], __ATOMIC_ACQUIRE);
+    int32_t diff= (int32_t)(seq-tail);
+    if( diff<0 ) return false; // The slot still holds the submission of ticket tail-CMD_SUBQ_SIZE: full
+    if( diff==0 ) {
+      // The slot is free: take the ticket (on failure, tail is updated to the current one)
+      if( __atomic_compare_exchange_n(&q->tail, &tail, tail+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) break;
+    } else {
+      tail= __atomic_load_n(&q->tail, __ATOMIC_RELAXED); // Another producer took this ticket
+    }
   }
-  if( argc==3 && cmd_isprefix(PSTR("wait"),argv[1]) ) {
-    int ms;
-    if( ! cmd_parse_dec(argv[2],&ms) ) { Serial.print("ERROR: error in wait time\n"); return; }
-    if( argv[0][0]!='@') { Serial.print(F("echo: wait: ")); Serial.print(ms); Serial.print(F("\n")); }
-    delay(ms);
-    return;
+  q->slots[tail%CMD_SUBQ_SIZE]= sub;
+  __atomic_store_n(&q->seqs[tail%CMD_SUBQ_SIZE], tail+1, __ATOMIC_RELEASE); // Publish the submission
+  return true;
+}
+
+
+// Producer side: returns true iff `sub` has finished.
+bool cmd_submit_done( const cmd_submit_t * sub ) {
+  return __atomic_load_n(&sub->done, __ATOMIC_ACQUIRE);
+}
+
+
+// Completes the running submission of `q` (its instance is current): its output and status
+static void cmd_subq_complete( cmd_subq_t * q ) {
+  cmd_submit_t * sub= q->cur;
+  cmd_outflush();
+  if( sub->outsize>0 ) sub->out[ sub->outlen<sub->outsize-1 ? sub->outlen : sub->outsize-1 ]= '\0';
+  sub->status= cmd_cur->status;
+  q->capture.sub= 0;
+  q->cur= 0;
+  __atomic_store_n(&sub->done, 1, __ATOMIC_RELEASE); // Hand the submission back
+}
+
+
+// Consumer side (the interpreter task): executes the submitted lines, in order, on the instance of `q`.
+void cmd_subq_poll( cmd_subq_t * q ) {
+  cmd_t * prev= cmd_select(q->cmd);
+  CMD_SCRATCH_OPEN();
+  for(;;) {
+    if( q->cur!=0 ) {
+      cmd_steptask();
+      if( cmd_cur->taskfunc ) break; // The running submission started a task; it completes when that ends
+      cmd_subq_complete(q);
+    }
+    // Take the next submission, and free its slot (for ticket head+CMD_SUBQ_SIZE)
+    uint32_t head= q->head;
+    if( __atomic_load_n(&q->seqs[head%CMD_SUBQ_SIZE], __ATOMIC_ACQUIRE)!=head+1 ) break; // Empty
+    q->cur= q->slots[head%CMD_SUBQ_SIZE];
+    __atomic_store_n(&q->seqs[head%CMD_SUBQ_SIZE], head+CMD_SUBQ_SIZE, __ATOMIC_RELEASE);
+    q->head= head+1;
+    // Execute it
+    q->capture.sub= q->cur;
+    cmd_addstr(q->cur->line);
+    cmd_add('\n');
+  }
+  CMD_SCRATCH_CLOSE();
+  cmd_select(prev);
+}
+
+
+#endif
+
+
+
+// Friend command: echo ================================================================
+
+
+#if CMD_ECHO_WAIT
+// The task for "echo wait": the state is the deadline (in millis)
+static bool cmdecho_waittask(uint32_t * state, bool cancel) {
+  return !cancel && (int32_t)(millis()-*state)<0;
+}
+#endif
+
+
+// The handlers for the subcommands of "echo" (vals as declared in cmdecho_subs)
+static void cmdecho_print() { cmd_out.print(F("echo: echoing ")); cmd_out.print(cmd_cur->echo?F("enabled"):F("disabled")); cmd_out.print(F("\n")); }
+static void cmdecho_words(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv;
+  if( n==0 ) cmdecho_print(); else { cmd_out.print(vals[0].str); cmd_out.print(F("\n")); }
+}
+#if CMD_BATCH
+static void cmdecho_batch(char * argv[], int n, const cmd_val_t * vals) {
+  if( n==1 ) cmd_set_batch(vals[0].index==1);
+  if( argv[0][0]!='@') { cmd_out.print(F("echo: batch: ")); cmd_out.print(cmd_get_batch()?F("on"):F("off")); cmd_out.print(F("\n")); }
+}
+#endif
+#if CMD_ECHO_ENABLE
+static void cmdecho_disabled(char * argv[], int n, const cmd_val_t * vals) {
+  (void)n; (void)vals;
+  cmd_cur->echo= false;
+  if( argv[0][0]!='@') cmdecho_print();
+}
+static void cmdecho_enabled(char * argv[], int n, const cmd_val_t * vals) {
+  (void)n; (void)vals;
+  cmd_cur->echo= true;
+  if( argv[0][0]!='@') cmdecho_print();
+}
+#endif
+#if CMD_ECHO_FAULTS
+static void cmdecho_faults(char * argv[], int n, const cmd_val_t * vals) {
+  (void)vals;
+  if( n==1 ) {
+    cmd_steperrorcount();
+    if( argv[0][0]!='@') cmd_out.print(F("echo: faults: stepped\n")); 
+  } else {
+    int count= cmd_geterrorcount();
+    if( argv[0][0]!='@') { cmd_out.print(F("echo: faults: ")); cmd_out.print(count); cmd_out.print(F("\n")); }
+  }
+}
+#endif
+#if CMD_FLOW
+static void cmdecho_flow(char * argv[], int n, const cmd_val_t * vals) {
+  if( n==1 ) cmd_set_flow(vals[0].index==0 ? CMD_FLOW_OFF : CMD_FLOW_XONXOFF, 0);
+  cmd_flowstats_t stats= cmd_get_flowstats(true);
+  if( argv[0][0]!='@') { 
+    int flow= cmd_get_flow();
+    cmd_out.print(F("echo: flow: ")); cmd_out.print(flow==CMD_FLOW_OFF?F("off"):flow==CMD_FLOW_XONXOFF?F("xonxoff"):F("rts"));
+    cmd_out.print(F(", rxpeak ")); cmd_out.print(stats.rxpeak); 
+    cmd_out.print(F(", bufpeak ")); cmd_out.print(stats.bufpeak); 
+    cmd_out.print(F(", stops ")); cmd_out.print(stats.stops); 
+    cmd_out.print(F("\n")); 
   }
-  int start= 1;
-  if( cmd_isprefix(PSTR("line"),argv[1]) ) { start=2; }
-  // This tries to restore the command line (put spaces back on the '\0's)
-  //char * s0=argv[start-1]+strlen(argv[start-1])+1;
-  //char * s1=argv[argc-1];
-  //for( char * p=s0; p<s1; p++ ) if( *p=='\0' ) *p=' ';
-  //Serial.print(s0); Serial.print(F("\n"));
-  for( int i=start; i<argc; i++) { if(i>start) Serial.print(' '); Serial.print(argv[i]);  }
-  Serial.print(F("\n"));
+}
+#endif
+static void cmdecho_line(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv;
+  if( n==1 ) cmd_out.print(vals[0].str);
+  cmd_out.print(F("\n"));
+}
+#if CMD_ECHO_WAIT
+static void cmdecho_wait(char * argv[], int n, const cmd_val_t * vals) {
+  (void)n;
+  int ms= vals[0].dec;
+  if( argv[0][0]!='@') { cmd_out.print(F("echo: wait: ")); cmd_out.print(ms); cmd_out.print(F("\n")); }
+  cmd_start_task(cmdecho_waittask, millis()+ms); // Do not delay(), input keeps flowing
+}
+#endif
+
+
+// The subcommands of "echo" (some can be left out, see CMD_ECHO_XXX)
+#if CMD_ECHO_ENABLE
+  #define CMDECHO_SUBS_ENABLE(X) \
+    X( disabled, "",   "",            cmdecho_disabled ) \
+    X( enabled,  "",   "",            cmdecho_enabled  )
+#else
+  #define CMDECHO_SUBS_ENABLE(X)
+#endif
+#if CMD_ECHO_FAULTS
+  #define CMDECHO_SUBS_FAULTS(X) \
+    X( faults,   "[e", "step",        cmdecho_faults   )
+#else
+  #define CMDECHO_SUBS_FAULTS(X)
+#endif
+#if CMD_ECHO_WAIT
+  #define CMDECHO_SUBS_WAIT(X) \
+    X( wait,     "d",  "",            cmdecho_wait     )
+#else
+  #define CMDECHO_SUBS_WAIT(X)
+#endif
+#if CMD_BATCH
+  #define CMDECHO_SUBS_BATCH(X) \
+    X( batch,    "[e", "off|on",      cmdecho_batch    )
+#else
+  #define CMDECHO_SUBS_BATCH(X)
+#endif
+#if CMD_FLOW
+  #define CMDECHO_SUBS_FLOW(X) \
+    X( flow,     "[e", "off|xonxoff", cmdecho_flow     )
+#else
+  #define CMDECHO_SUBS_FLOW(X)
+#endif
+#define CMDECHO_SUBS(X) \
+  X(         , "[r", "",            cmdecho_words    ) \
+  CMDECHO_SUBS_BATCH(X) \
+  CMDECHO_SUBS_ENABLE(X) \
+  CMDECHO_SUBS_FAULTS(X) \
+  CMDECHO_SUBS_FLOW(X) \
+  X( line,     "[r", "",            cmdecho_line     ) \
+  CMDECHO_SUBS_WAIT(X)
+CMD_SUBS(cmdecho_subs, CMDECHO_SUBS)
+
+
+// The handler for the "echo" command
+void cmdecho_main(int argc, char * argv[]) {
+  cmd_dispatch(argc, argv, cmdecho_subs, CMD_TABLE_COUNT(cmdecho_subs));
 }
 
 
-static const char cmdecho_longhelp[] PROGMEM = 
+const char cmdecho_longhelp[] PROGMEM = 
   "SYNTAX: echo [line] <word>...\n"
   "- prints all words (useful in scripts)\n"
   "SYNTAX: [@]echo faults [step]\n"
@@ -423,14 +2411,27 @@ static const char cmdecho_longhelp[] PROGMEM =
   "- with @ present, no feedback is printed\n"
   "- without arguments shows status of terminal echoing\n"
   "SYNTAX: [@]echo wait <time>\n"
-  "- waits <time> ms (might be useful in scripts)\n"
+  "- waits <time> ms (might be useful in scripts), Ctrl-C cancels\n"
+  "- with @ present, no feedback is printed\n"
+  "SYNTAX: [@]echo batch [ off | on ]\n"
+  "- with argument switches batch mode: no echo, no prompt, a status frame after each command\n"
+  "- the frame is '#<seq> OK' or '#<seq> ERR <code>', <seq> counts from 0 (when switched on)\n"
+  "- with @ present, no feedback is printed\n"
+  "SYNTAX: [@]echo flow [ off | xonxoff ]\n"
+  "- with argument sets flow control (xonxoff stops the sender instead of losing input)\n"
+  "- shows and resets the flow counters: peak fill of the receive buffer and of the line, and sender stops\n"
   "- with @ present, no feedback is printed\n"
   "NOTES:\n"
   "- 'echo line' prints a white line (there are no <word>s)\n"
   "- 'echo line faults' prints 'faults'\n"
+  "- 'echo line flow' prints 'flow'\n"
   "- 'echo line enabled' prints 'enabled'\n"
   "- 'echo line disabled' prints 'disabled'\n"
   "- 'echo line line' prints 'line'\n"
+  "- 'echo line wait' prints 'wait'\n"
+  "- 'echo line batch' prints 'batch'\n"
+  "- commands on one line are separated by ';' ('echo line a; echo line b')\n"
+  "- subcommands may be abbreviated ('echo f' is 'echo faults', 'echo fl' is 'echo flow')\n"
 ;
 
 
@@ -442,58 +2443,269 @@ int cmdecho_register(void) {
 // Friend command: help =================================================================
 
 
+// The dictionary for compressed help texts: `count` pairs
+static const uint8_t * cmd_helpdict= 0;
+static int cmd_helpdict_count= 0;
+
+
+// Installs the dictionary for compressed help texts (generated by extras/helpz/helpz.py).
+void cmd_set_helpdict(/*PROGMEM*/const uint8_t * dict, int count) {
+  cmd_helpdict= dict;
+  cmd_helpdict_count= count;
+}
+
+
+// Prints (PROGMEM) help text `str`, which may be compressed, to cmd_out.
+// Chars are collected in a chunk of (scratch) RAM and written per chunk (without CMD_HELP_CHUNKS they are written one by one).
+void cmd_helpprint(/*PROGMEM*/const char * str) {
+#if CMD_HELP_CHUNKS
+  #define SIZE 32
+  char * ram= (char *)cmd_scratch_alloc(SIZE);
+  if( ram==0 ) {
+    if( pgm_read_byte(str)!=CMD_HELPZ_MARK ) { cmd_out.print(f(str)); return; } // Char by char
+    cmd_out.print(F("ERROR: help: out of memory\n")); // Compressed text would print as garbage
+    cmd_set_status(CMD_ERR_SCRATCH);
+    return;
+  }
+  int len= 0;
+  #define PUT(c) do { ram[len++]= (c); if( len==SIZE ) { cmd_out.write(ram, len); len= 0; } } while(0)
+#else
+  #define PUT(c) cmd_out.write((uint8_t)(c))
+#endif
+  if( pgm_read_byte(str)==CMD_HELPZ_MARK ) {
+    // Expand each byte with a small stack: a dictionary entry is replaced by its pair, a char is output
+    uint8_t stack[CMD_HELPZ_DEPTH];
+    uint8_t b;
+    str++;
+    while( (b=pgm_read_byte(str++)) != 0 ) {
+      int sp= 0;
+      stack[sp++]= b;
+      while( sp>0 ) {
+        b= stack[--sp];
+        if( b<0x80 ) {
+          PUT(b);
+        } else if( b-0x80<cmd_helpdict_count && sp+2<=CMD_HELPZ_DEPTH ) {
+          const uint8_t * pair= cmd_helpdict + 2*(b-0x80);
+          stack[sp++]= pgm_read_byte(pair+1);
+          stack[sp++]= pgm_read_byte(pair);
+        } else {
+          PUT('?'); // No (or wrong) dictionary
+        }
+      }
+    }
+  } else {
+#if CMD_HELP_CHUNKS
+    // Copy chunks of str in PROGMEM via RAM
+    int n= strlen_P(str);
+    while( n>0 ) {
+      int size= n<SIZE ? n : SIZE;
+      memcpy_P(ram, str, size);
+      cmd_out.write(ram, size);
+      str+= size;
+      n-= size;
+    }
+#else
+    cmd_out.print(f(str));
+#endif
+  }
+#if CMD_HELP_CHUNKS
+  if( len>0 ) cmd_out.write(ram, len);
+  cmd_scratch_free(ram);
+  #undef SIZE
+#endif
+  #undef PUT
+}
+
+
 // The handler for the "help" command
-static void cmdhelp_main(int argc, char * argv[]) {
+void cmdhelp_main(int argc, char * argv[]) {
   if( argc==1 ) {
-    Serial.print(F("Available commands\n"));
-    for( int i=0; i<cmd_descs_count; i++ ) {
-      Serial.print(f(cmd_descs[i].name));
-      Serial.print(F(" - "));
-      Serial.print(f(cmd_descs[i].shorthelp));
-      Serial.print(F("\n"));
+    cmd_out.print(F("Available commands\n"));
+    // Merge the flash table and cmd_descs[] (both are sorted)
+    int i1= 0;
+    int i2= cmd_table_count;
+    int end= cmd_table_count+cmd_descs_count;
+    while( i1<cmd_table_count || i2<end ) {
+      cmd_desc_t d;
+      if( i2==end || (i1<cmd_table_count && cmd_strcmp_PP(cmd_desc_name(i1),cmd_desc_name(i2))<=0) ) cmd_desc_get(i1++,&d); else cmd_desc_get(i2++,&d);
+      cmd_out.print(f(d.name));
+      cmd_out.print(F(" - "));
+      cmd_helpprint(d.shorthelp);
+      cmd_out.print(F("\n"));
     }
   } else if( argc==2 ) {
-    cmd_desc_t * d= cmd_find(argv[1]);
-    if( d==0 ) {
-      Serial.print(F("ERROR: command not found (try 'help')\n"));    
+    bool ambiguous;
+    cmd_desc_t d;
+    if( !cmd_find(argv[1],&d,&ambiguous) ) {
+      cmd_out.print(ambiguous ? F("ERROR: command ambiguous (try 'help')\n") : F("ERROR: command not found (try 'help')\n"));    
+      cmd_set_status(ambiguous ? CMD_ERR_AMBIGUOUS : CMD_ERR_NOTFOUND);
     } else {
-      // Copy chunks of longhelp in PROGMEM via RAM to Serial
-      const char * str= d->longhelp;
-      int len= strlen_P(str);
-      while( len>0 ) {
-          #define SIZE 32
-          char ram[SIZE+1];
-          int size= len<SIZE ? len : SIZE;
-          memcpy_P(ram, str, size);
-          ram[size]='\0';
-          Serial.print(ram);
-          str+= size;
-          len-= size;
-      }
+      cmd_helpprint(d.longhelp);
       // longhelp is in PROGMEM so we need to get the chars one by one...
       //for(unsigned i=0; i<strlen_P(d->longhelp); i++) 
-      //  Serial.print((char)pgm_read_byte_near(d->longhelp+i));
+      //  cmd_out.print((char)pgm_read_byte_near(d->longhelp+i));
     }
   } else {
-    Serial.print(F("ERROR: too many arguments\n"));
+    cmd_out.print(F("ERROR: too many arguments\n"));
+    cmd_set_status(CMD_ERR_ARGS);
   }
 }
 
 
-static const char cmdhelp_longhelp[] PROGMEM = 
+const char cmdhelp_longhelp[] PROGMEM = 
   "SYNTAX: help\n"
   "- lists all commands\n"
   "SYNTAX: help <cmd>\n"
   "- gives detailed help on command <cmd>\n"
   "NOTES:\n"
   "- all commands may be shortened, for example 'help', 'hel', 'he', 'h'\n"
+  "- a shortened command must be unique, commands are listed alphabetically\n"
   "- all sub commands may be shortened, for example 'help help' to 'help h'\n"
   "- normal prompt is >>, other prompt indicates streaming mode\n"
   "- commands may be suffixed with a comment starting with //\n"
   "- some commands support a @ as prefix; it suppresses output of that command\n"
+  "- a long running command can be cancelled with Ctrl-C\n"
 ;
 
 
 int cmdhelp_register(void) {
   return cmd_register(cmdhelp_main, PSTR("help"), PSTR("gives help (try 'help help')"), cmdhelp_longhelp);
 }
+
+
+#if CMD_PROF || CMD_TRACE
+// Prints `val` right aligned in a field of `width` chars (for the tables of prof and trace)
+static void cmd_print_right(uint32_t val, int width) {
+  uint32_t v= val;
+  while( v>=10 ) { v/= 10; width--; }
+  while( width-- > 1 ) cmd_out.print(' ');
+  cmd_out.print(val);
+}
+#endif
+
+
+#if CMD_PROF
+
+
+// Friend command: prof ================================================================
+
+
+// The handler for the "prof" command
+void cmdprof_main(int argc, char * argv[]) {
+  if( argc==2 && cmd_isprefix(PSTR("reset"),argv[1]) ) {
+    memset(cmd_profs, 0, sizeof cmd_profs);
+    memset(&cmd_prof_all, 0, sizeof cmd_prof_all);
+    cmd_get_scratchpeak(true);
+    if( argv[0][0]!='@') cmd_out.print(F("prof: reset\n"));
+    return;
+  }
+  if( argc!=1 ) { cmd_out.print(F("ERROR: prof: unknown argument (try 'help prof')\n")); cmd_set_status(CMD_ERR_ARGS); return; }
+  cmd_out.print(F("prof: lines ")); cmd_out.print(cmd_prof_all.lines);
+  cmd_out.print(F(", exec ")); cmd_out.print(cmd_prof_all.exec);
+  cmd_out.print(F("us, full ")); cmd_out.print(cmd_prof_all.full);
+  cmd_out.print(F(", overflows ")); cmd_out.print(cmd_prof_all.overflows);
+  cmd_out.print(F(", untracked ")); cmd_out.print(cmd_prof_all.untracked);
+  cmd_out.print(F(", scratch peak ")); cmd_out.print(cmd_get_scratchpeak(false)); cmd_out.print('/'); cmd_out.print((int)CMD_SCRATCH_SIZE);
+  cmd_out.print(F("\n     count    min   mean    max   echoed      out  command\n"));
+  for( cmd_prof_t * p= cmd_profs; p<cmd_profs+CMD_PROF_SLOTS && p->name!=0; p++ ) {
+    cmd_print_right(p->count, 10);
+    cmd_print_right(p->min, 7);
+    cmd_print_right(p->sum/p->count, 7);
+    cmd_print_right(p->max, 7);
+    cmd_print_right(p->echoed, 9);
+    cmd_print_right(p->out, 9);
+    cmd_out.print(F("  ")); cmd_out.print(f(p->name)); cmd_out.print(F("\n"));
+  }
+}
+
+
+const char cmdprof_longhelp[] PROGMEM = 
+  "SYNTAX: prof\n"
+  "- shows the profiling counters\n"
+  "- lines: number of lines executed\n"
+  "- exec: time in us to split and look up those lines (excluding the commands)\n"
+  "- full: chars dropped because the line was too long\n"
+  "- overflows: receive buffer overflows\n"
+  "- scratch peak: highest use of the scratch arena (see CMD_SCRATCH_SIZE)\n"
+  "- per command: invocations, min/mean/max time in us, bytes echoed and output\n"
+  "SYNTAX: [@]prof reset\n"
+  "- resets the profiling counters\n"
+  "NOTES:\n"
+  "- with @ present, no feedback is printed\n"
+;
+
+
+int cmdprof_register(void) {
+  return cmd_register(cmdprof_main, PSTR("prof"), PSTR("shows profiling counters"), cmdprof_longhelp);
+}
+
+
+#endif
+
+
+#if CMD_TRACE
+
+
+// Friend command: trace ===============================================================
+
+
+// The handlers for the subcommands of "trace" (vals as declared in cmdtrace_subs)
+static void cmdtrace_show(char * argv[], int n, const cmd_val_t * vals) {
+  (void)argv; (void)n; (void)vals;
+  int count= cmd_trace_count<CMD_TRACE_SIZE ? cmd_trace_count : CMD_TRACE_SIZE;
+  cmd_out.print(F("trace: ")); cmd_out.print(count); 
+  cmd_out.print(F(" of ")); cmd_out.print(cmd_trace_count); 
+  cmd_out.print(F(" lines\n        ms       us  st  line\n"));
+  // Oldest first; the entry of this trace command itself is the last one
+  for( int age=count-1; age>=0; age-- ) {
+    const cmd_trace_t * t= cmd_trace_get(age);
+    cmd_print_right(t->ms, 10);
+    cmd_print_right(t->us, 9);
+    cmd_print_right(t->status, 4);
+    cmd_out.print(F("  "));
+    if( t->name!=0 ) { cmd_out.print(f(t->name)); if( t->len>0 ) cmd_out.print(' '); }
+    int len= t->len<CMD_TRACE_ARGSIZE ? t->len : CMD_TRACE_ARGSIZE;
+    for( int i=0; i<len; i++ ) cmd_out.print( t->args[i]=='\0' ? ' ' : t->args[i] );
+    if( t->len>CMD_TRACE_ARGSIZE ) cmd_out.print(F("..."));
+    cmd_out.print(F("\n"));
+  }
+}
+static void cmdtrace_clear(char * argv[], int n, const cmd_val_t * vals) {
+  (void)n; (void)vals;
+  cmd_trace_count= 0;
+  if( argv[0][0]!='@') cmd_out.print(F("trace: cleared\n"));
+}
+
+
+#define CMDTRACE_SUBS(X) \
+  X(      , "", "", cmdtrace_show  ) \
+  X( clear, "", "", cmdtrace_clear )
+CMD_SUBS(cmdtrace_subs, CMDTRACE_SUBS)
+
+
+// The handler for the "trace" command
+void cmdtrace_main(int argc, char * argv[]) {
+  cmd_dispatch(argc, argv, cmdtrace_subs, CMD_TABLE_COUNT(cmdtrace_subs));
+}
+
+
+const char cmdtrace_longhelp[] PROGMEM = 
+  "SYNTAX: trace\n"
+  "- shows the last executed lines, oldest first\n"
+  "- ms: time the line started, us: its execution time\n"
+  "- st: status (0 ok, 1 not found, 2 ambiguous, 3 arguments, ...)\n"
+  "- line: the command (resolved) and the start of its arguments\n"
+  "SYNTAX: [@]trace clear\n"
+  "- clears the trace\n"
+  "NOTES:\n"
+  "- a line that starts a task shows the status when it started\n"
+  "- with @ present, no feedback is printed\n"
+;
+
+
+int cmdtrace_register(void) {
+  return cmd_register(cmdtrace_main, PSTR("trace"), PSTR("shows the last executed lines"), cmdtrace_longhelp);
+}
+
+
+#endif
@@ -5,10 +5,38 @@
 
 
 #include <stdint.h> // uint16_t
+#include <stddef.h> // size_t
+#include <Arduino.h> // Print
 
 
 // Version of this library
-#define CMD_VERSION "8.2.3" 
+#define CMD_VERSION "8.3.0" 
+// Changed 8.2.3 -> 8.3.0:
+//   added cmd_addbuf() for bulk input, cmd_pollserial() reads Serial in chunks
+//   added binary streaming mode (COBS frames with CRC) via cmd_set_binfunc(), the enabling line may end in "\r\n"
+//   added raw streaming mode (untokenized lines) via cmd_set_streamrawfunc()
+//   all output goes via output queue cmd_out (drained without blocking, flushed before each command: CMD_OUTFLUSH), cmd_printf() has no length limit
+//   multiple interpreter instances, each on its own Stream, with cmd_init(cmd,stream,rxsize) and cmd_poll(cmd)
+//   added lock-free receive ring cmd_rx_t, to be filled from an ISR, DMA callback or other task
+//   added cooperative tasks for long running commands (cmd_start_task), echo wait uses it, Ctrl-C cancels
+//   while a task runs, the poll functions only read the type-ahead that fits (cmd_feedroom), the rest stays pending
+//   parse functions use SWAR, cmd_parse_dec() overflow check fixed, added cmd_parse_xxx_array()
+//   commands are kept sorted, cmd_find() uses binary search and reports ambiguous abbreviations
+//   commands can be declared at compile time in a PROGMEM table (CMD_TABLE, cmd_register_table)
+//   added profiling counters (CMD_PROF) and friend command prof
+//   added flow control (XON/XOFF or RTS) with cmd_set_flow(), and peak fill levels with cmd_get_flowstats()
+//   added compiled scripts (CMD_SCRIPT, cmd_script_run), replayed without the interpreter's char handling
+//   buffer sizes per instance (CMD_CONFIG), transient buffers from one scratch arena (CMD_SCRATCH_SIZE replaces CMD_PRT_SIZE)
+//   help texts may be compressed (extras/helpz), see cmd_set_helpdict()
+//   commands may declare subcommands with typed arguments (CMD_SUBS, cmd_dispatch), echo uses that
+//   a line may hold several commands separated by ';' (not streaming data, cmd_set_split), batch mode (cmd_set_batch, echo batch) with status frames
+//   added streaming statistics cmd_stats_t (mean, variance, min/max, histogram, quantile estimates)
+//   added event-driven input cmd_feed(), cmd_waitms() and wakeup latency (cmd_set_wakestats); host driver on epoll/pty
+//   added trace ring of the last executed lines (CMD_TRACE, cmd_trace_get) and friend command trace
+//   lines are tokenized (arguments, comment, ';', command lookup) while entered, execution needs no scan; CMD_CONFIG has argv
+//   added submission queue cmd_subq_t: other tasks submit lines (cmd_submit), with captured output and status
+//   compile-time feature switches (CMD_ECHO_FAULTS, CMD_HEX32, CMD_BINARY, CMD_FLOW, ...) and their size report (extras/size, --baseline)
+//   on AVR the scratch arena is on the stack (CMD_SCRATCH_STACK), argv is built in scratch (CMD_ARGV_SCRATCH), no output queue
 // Changed 8.2.2 -> 8.2.3:
 //   replaced all println by print(...\n) to get rid of \r\n in favor of \n
 // Changed 8.2.1 -> 8.2.2:
@@ -44,17 +72,163 @@
 #endif
 
 
-// The maximum number of characters the interpreter can buffer.
+// Features that can be left out to save flash and RAM: set to 0 here, or on the compiler command line (e.g. -DCMD_HEX32=0).
+// The script extras/size/size.py reports what each costs.
+#ifndef CMD_ECHO_FAULTS
+  #define CMD_ECHO_FAULTS 1  // Subcommand 'echo faults' (the error counter itself stays)
+#endif
+#ifndef CMD_ECHO_WAIT
+  #define CMD_ECHO_WAIT 1    // Subcommand 'echo wait'
+#endif
+#ifndef CMD_ECHO_ENABLE
+  #define CMD_ECHO_ENABLE 1  // Subcommands 'echo enabled' and 'echo disabled' (echo is then always on, except in batch mode)
+#endif
+#ifndef CMD_PRINTF_P
+  #define CMD_PRINTF_P 1     // cmd_printf_P()
+#endif
+#ifndef CMD_HEX32
+  #define CMD_HEX32 1        // cmd_parse_hex32(), cmd_parse_hex32_array(), and argument type 'H' of subcommands
+#endif
+#ifndef CMD_STREAMPROMPT
+  #define CMD_STREAMPROMPT 1 // cmd_set_streamprompt(), cmd_set_streampromptf(), cmd_get_streamprompt(); without, streaming prompts "> "
+#endif
+#ifndef CMD_HELP_CHUNKS
+  #define CMD_HELP_CHUNKS 1  // cmd_helpprint() writes help text per chunk (of scratch RAM); without, it writes char by char
+#endif
+#ifndef CMD_BINARY
+  #define CMD_BINARY 1       // Binary streaming mode: cmd_set_binfunc(), cmd_get_binfunc(), cmd_crc16()
+#endif
+#ifndef CMD_FLOW
+  #define CMD_FLOW 1         // Flow control and input counters: cmd_set_flow(), cmd_get_flowstats(), ..., and subcommand 'echo flow'
+#endif
+#ifndef CMD_BATCH
+  #define CMD_BATCH 1        // Batch mode (status frames): cmd_set_batch(), cmd_get_batch(), and subcommand 'echo batch' (the status stays)
+#endif
+#ifndef CMD_STATS
+  #define CMD_STATS 1        // Streaming statistics (cmd_stats_t), and wakeup latency of event-driven input (cmd_set_wakestats)
+#endif
+
+
+// The maximum number of characters the interpreter can buffer (default, see CMD_CONFIG for other sizes per instance).
 // The buffer is cleared when executing a command. Execution happens when a <CR> or <LF> is passed.
 #define CMD_BUFSIZE 128
-// When a command starts executing, it is split in arguments.
+// While a line is entered, it is split in arguments (default maximum, see CMD_CONFIG).
 #define CMD_MAXARGS 32
 // Total number of registration slots.
 #define CMD_REGISTRATION_SLOTS 20
-// Size of buffer for the streaming prompt
-#define CMD_PROMPT_SIZE 10 
-// Size of buffer for cmd_prt
-#define CMD_PRT_SIZE 80 
+// Size of buffer for the streaming prompt (default, see CMD_CONFIG)
+#if CMD_STREAMPROMPT
+  #define CMD_PROMPT_SIZE 10 
+#else
+  #define CMD_PROMPT_SIZE 1 // Unused
+#endif
+// The char that cancels a running task (Ctrl-C)
+#define CMD_CANCEL 0x03
+// Size of the output queue (default, see CMD_CONFIG). With 0 there is no queue: output goes straight to the stream.
+#ifndef CMD_OUTSIZE
+  #if defined(__AVR__)
+    #define CMD_OUTSIZE 0 // RAM is scarce, and the transmit buffer of HardwareSerial already is a queue
+  #else
+    #define CMD_OUTSIZE 64
+  #endif
+#endif
+// When the output queue is full: 1 waits until Serial accepts the bytes (a stall), 0 drops the bytes
+#define CMD_OUTBLOCK 1
+// When 1, the output queue is flushed (blocking) before a command (or streaming function) executes.
+// Needed when commands print directly to Serial (and not via cmd_out), otherwise their output is out of order.
+// When all commands print via cmd_out, 0 saves the wait for the UART before each command.
+#ifndef CMD_OUTFLUSH
+  #define CMD_OUTFLUSH 1
+#endif
+// Size of a receive ring (cmd_rx_t), must be a power of 2
+#define CMD_RXSIZE 64
+// Size of the chunks cmd_pollserial() reads from Serial (from the scratch arena)
+#define CMD_POLLSIZE 32
+// Size of the receive buffer of Serial; when cmd_pollserial() reads that many bytes in one go, it assumes an overflow
+#if defined(ESP8266)
+  #define CMD_SERIAL_RXSIZE 0 // Not needed, ESP8266 has Serial.hasOverrun()
+#elif defined(ESP32)
+  #define CMD_SERIAL_RXSIZE 256 // Hack; default RC buffer size is 256, see HardwareSerial.cpp line 55: _uart = uartBegin(...256...);
+#elif CMD_HOST
+  #define CMD_SERIAL_RXSIZE 0 // Not needed, stdin (a pipe or terminal) does not lose bytes
+#else
+  #define CMD_SERIAL_RXSIZE SERIAL_RX_BUFFER_SIZE
+#endif
+// When 1, the interpreter keeps profiling counters (see cmdprof_register); when 0 there is no code and no RAM for them
+#ifndef CMD_PROF
+  #if defined(__AVR__)
+    #define CMD_PROF 0 // RAM is scarce
+  #else
+    #define CMD_PROF 1
+  #endif
+#endif
+// Number of commands (including the streaming handlers) that get profiling counters
+#define CMD_PROF_SLOTS 16
+// When 1, the interpreter records the last CMD_TRACE_SIZE executed lines in a ring (see cmdtrace_register)
+#ifndef CMD_TRACE
+  #if defined(__AVR__)
+    #define CMD_TRACE 0 // RAM is scarce
+  #else
+    #define CMD_TRACE 1
+  #endif
+#endif
+// Number of entries in the trace ring, and the number of argument chars each entry keeps
+#define CMD_TRACE_SIZE 16
+#define CMD_TRACE_ARGSIZE 12
+// When 1, the scratch arena is not static RAM: the outermost call into the interpreter (cmd_poll, cmd_addstr, 
+// cmd_script_run, ...) takes it from the stack, as the buffers it replaced were. Outside such a call 
+// (e.g. cmd_printf in setup) there is no scratch. When 0, the arena is static RAM, also while idle.
+#ifndef CMD_SCRATCH_STACK
+  #if defined(__AVR__)
+    #define CMD_SCRATCH_STACK 1 // RAM is scarce
+  #else
+    #define CMD_SCRATCH_STACK 0
+  #endif
+#endif
+// Size of the scratch arena: the transient buffers (rest of a ';' line, script step, input chunks, printf, help text) are carved from it.
+// It is shared by all instances. Nested use (a command that issues a command) needs more; see cmd_get_scratchpeak() to size it.
+// cmd_printf() uses what is left; longer output is formatted in pieces.
+// On AVR with a static arena a long rest of a ';' line (more than half a line) may not fit ("out of scratch memory").
+// On the stack it fits replaying a full line of type-ahead (see Tasks), which also collects an argv (CMD_ARGV_SCRATCH).
+#ifndef CMD_SCRATCH_SIZE
+  #if defined(__AVR__) && CMD_SCRATCH_STACK
+    #define CMD_SCRATCH_SIZE ( CMD_BUFSIZE + CMD_POLLSIZE + 32 )
+  #elif defined(__AVR__)
+    #define CMD_SCRATCH_SIZE ( CMD_BUFSIZE/2 + CMD_POLLSIZE + 32 )
+  #else
+    #define CMD_SCRATCH_SIZE ( CMD_BUFSIZE + 2*CMD_POLLSIZE + 32 )
+  #endif
+#endif
+// When 1, the default instance (and instances with heap buffers) keeps no argv (CMD_MAXARGS pointers): the tokenizer 
+// still cuts the line while it is entered, and the argv is collected in scratch when the line executes.
+#ifndef CMD_ARGV_SCRATCH
+  #if defined(__AVR__)
+    #define CMD_ARGV_SCRATCH 1 // RAM is scarce
+  #else
+    #define CMD_ARGV_SCRATCH 0
+  #endif
+#endif
+// Maximum nesting of compressed help text (see cmd_set_helpdict); the decoder needs this many bytes of stack
+#define CMD_HELPZ_DEPTH 16
+// Flow control: default high-water and low-water mark (bytes pending in the receive buffer of the stream), see cmd_set_flowmarks()
+#define CMD_FLOW_HIGH 32
+#define CMD_FLOW_LOW 8
+// Flow control: a line that executes longer than this (us) is "slow"; before the next line executes the sender is stopped
+#define CMD_FLOW_SLOWUS 1000
+// Number of histogram bins of streaming statistics (cmd_stats_t)
+#define CMD_STATS_BINS 16
+// Event-driven input: how long (ms) a driver sleeps while a task runs (see cmd_waitms)
+#define CMD_FEED_TICKMS 1
+// When 1, other tasks (threads) can submit lines to a submission queue (cmd_subq_t); it needs atomic compare-and-swap
+#ifndef CMD_SUBMIT
+  #if defined(__AVR__)
+    #define CMD_SUBMIT 0 // No tasks
+  #else
+    #define CMD_SUBMIT 1
+  #endif
+#endif
+// Number of submissions a submission queue holds, must be a power of 2
+#define CMD_SUBQ_SIZE 8
 
 
 // A command must implement a 'main' function. It is much like C's main, it has argc and argv.
@@ -66,6 +240,173 @@ int cmd_register(cmd_func_t main, const char * name, const char * shorthelp, con
 // There are two standard commands, closely integrated with the command handler
 int cmdecho_register(void);
 int cmdhelp_register(void);
+#if CMD_PROF
+// A third standard command 'prof' shows (and resets) the profiling counters: per command the number of 
+// invocations, min/mean/max execution time, and bytes echoed and output; and for the interpreter the number of 
+// lines, the time spent splitting and looking up lines, buffer full events and serial overflows.
+int cmdprof_register(void);
+void cmdprof_main(int argc, char * argv[]);
+extern const char cmdprof_longhelp[] PROGMEM;
+#endif
+#if CMD_TRACE
+// The interpreter records each executed line in a ring of CMD_TRACE_SIZE entries: recording is a few stores 
+// (no formatting), the standard command 'trace' dumps (and clears) the ring.
+typedef struct cmd_trace_s {
+  uint32_t     ms;     // Time (millis) the line started executing
+  uint32_t     us;     // Execution time of the handler
+  const char * name;   // Name of the handler (PROGMEM): a command, "(stream)", "(raw)"; 0 when not found
+  uint8_t      status; // Status of the line (CMD_OK, CMD_ERR_NOTFOUND, CMD_ERR_ARGS, ...)
+  uint8_t      len;    // Length of the arguments (capped at 255); only the first CMD_TRACE_ARGSIZE are kept
+  char         args[CMD_TRACE_ARGSIZE]; // The arguments, separated by '\0' (not terminated)
+} cmd_trace_t;
+// Returns the entry of the line executed `age` lines ago (0 is the last), or 0 when there is no such entry.
+const cmd_trace_t * cmd_trace_get(int age);
+int cmdtrace_register(void);
+void cmdtrace_main(int argc, char * argv[]);
+extern const char cmdtrace_longhelp[] PROGMEM;
+#endif
+
+
+// Instead of (or next to) registering commands at runtime, the command set can be declared at compile time.
+// Such a table is in PROGMEM: it costs no RAM, has no slot limit and no registration at startup.
+// The table is a list macro with one X(name,main,shorthelp,longhelp) per command, in alphabetical order
+// (typically each X on its own line, ending with a backslash):
+//   #define MYCMDS(X)  X( help, cmdhelp_main, "gives help", cmdhelp_longhelp )  X( stat, cmdstat_main, "statistics", cmdstat_longhelp )
+//   CMD_TABLE(mycmds, MYCMDS)
+// Then call cmd_register_table(mycmds, CMD_TABLE_COUNT(mycmds)) once (before or after cmd_init()).
+// Notes: a name is a C identifier (not a string), a shorthelp is a string literal, a longhelp a PROGMEM array.
+// The order is checked at compile time. Commands registered with cmd_register() are added to those of the table.
+typedef struct cmd_desc_s { 
+  cmd_func_t   main; 
+  const char * name; 
+  const char * shorthelp; 
+  const char * longhelp; 
+} cmd_desc_t;
+// Makes the PROGMEM `table` of `count` descriptors (sorted on name) the compile-time command set.
+void cmd_register_table(/*PROGMEM*/const cmd_desc_t * table, int count);
+// Help texts (long and short) may be compressed, to save flash. The tool extras/helpz/helpz.py generates them 
+// from the (verbatim) help texts in the sources, together with their dictionary of pairs. A compressed text starts 
+// with CMD_HELPZ_MARK; the other bytes are chars (below 0x80) or dictionary entries (0x80 and up), each a pair of bytes.
+// The application must install the dictionary with cmd_set_helpdict(dict,count) (count pairs, at most 128).
+#define CMD_HELPZ_MARK 0x01
+void cmd_set_helpdict(/*PROGMEM*/const uint8_t * dict, int count);
+// Prints (PROGMEM) help text `str`, which may be compressed, to cmd_out.
+void cmd_helpprint(/*PROGMEM*/const char * str);
+// The standard commands, to be used in a table
+void cmdecho_main(int argc, char * argv[]);
+void cmdhelp_main(int argc, char * argv[]);
+extern const char cmdecho_longhelp[] PROGMEM;
+extern const char cmdhelp_longhelp[] PROGMEM;
+// Implementation of the table macros
+#define CMD_TABLE_COUNT(table) ((int)(sizeof(table)/sizeof(table[0])))
+#define CMD_TABLE_STRS(name,main,shorthelp,longhelp) static const char cmd_tname_##name[] PROGMEM = #name; static const char cmd_tshort_##name[] PROGMEM = shorthelp;
+#define CMD_TABLE_NAME(name,main,shorthelp,longhelp) #name,
+#define CMD_TABLE_DESC(name,main,shorthelp,longhelp) { main, cmd_tname_##name, cmd_tshort_##name, longhelp },
+#define CMD_TABLE(table,list) \
+  list(CMD_TABLE_STRS) \
+  static constexpr const char * table##_names[] = { list(CMD_TABLE_NAME) }; \
+  static_assert( cmd_table_sorted(table##_names, CMD_TABLE_COUNT(table##_names)), "CMD_TABLE " #table ": commands must be in alphabetical order" ); \
+  static const cmd_desc_t table[] PROGMEM = { list(CMD_TABLE_DESC) };
+// Compile-time helpers for CMD_TABLE (C++11 constexpr, so recursion instead of loops)
+constexpr int cmd_table_strcmp(const char * s1, const char * s2) { 
+  return *s1!=*s2 ? ( (unsigned char)*s1<(unsigned char)*s2 ? -1 : +1 ) : *s1=='\0' ? 0 : cmd_table_strcmp(s1+1,s2+1); 
+}
+constexpr bool cmd_table_sorted(const char * const * names, int count) { 
+  return count<2 || ( cmd_table_strcmp(names[0],names[1])<0 && cmd_table_sorted(names+1,count-1) ); 
+}
+
+
+// Scripts: cmd_addstr_P() feeds a script char by char through the interpreter (echo, comment stripping, 
+// splitting, command lookup). A compiled script is prepared at compile time: each step has its handler and
+// line in PROGMEM (the arguments separated by spaces).
+// The script is a list macro with one X(main,line) per step:
+//   #define SELFTEST(X)  X( cmdecho_main, "echo line selftest" )  X( cmdstat_main, "stat 1 2 3" )
+//   CMD_SCRIPT(selftest, SELFTEST)
+// Then cmd_script_run(&selftest,1,false) calls the handlers directly (no lookup), with argv cut from the line.
+// Notes: there is no echo and no prompt; streaming mode does not apply (a step always calls its handler).
+// The line length (CMD_BUFSIZE) and argument count (CMD_MAXARGS) are checked at compile time.
+typedef struct cmd_step_s {
+  cmd_func_t main; // The handler of the step
+  uint8_t    len;  // Length of the line
+} cmd_step_t;
+typedef struct cmd_script_s {
+  /*PROGMEM*/const cmd_step_t * steps; // The steps
+  /*PROGMEM*/const char *       lines; // The lines of all steps, each 0-terminated, in order
+  int                           count; // Number of steps
+} cmd_script_t;
+// Runs all steps of `script`, `loops` times. With `timing`, prints the execution time of each step.
+// A step that starts a task (e.g. "echo wait 100") blocks until the task ends. Returns the total execution time in us.
+uint32_t cmd_script_run(const cmd_script_t * script, int loops, bool timing);
+// Implementation of the script macros
+#define CMD_SCRIPT_LINE(main,line) line "\0"
+#define CMD_SCRIPT_STEP(main,line) { main, sizeof(line)-1 },
+#define CMD_SCRIPT_CHECK(main,line) static_assert( sizeof(line)<=CMD_BUFSIZE && cmd_script_argc(line)<=CMD_MAXARGS, "CMD_SCRIPT: line too long or too many arguments: " line );
+#define CMD_SCRIPT(script,list) \
+  list(CMD_SCRIPT_CHECK) \
+  static const char script##_lines[] PROGMEM = list(CMD_SCRIPT_LINE); \
+  static const cmd_step_t script##_steps[] PROGMEM = { list(CMD_SCRIPT_STEP) }; \
+  static const cmd_script_t script = { script##_steps, script##_lines, CMD_TABLE_COUNT(script##_steps) };
+// Compile-time helper for CMD_SCRIPT: counts the arguments (space separated) in `s`
+constexpr int cmd_script_argc(const char * s, bool inword=false) {
+  return *s=='\0' ? 0 : ( *s!=' ' && !inword ? 1 : 0 ) + cmd_script_argc(s+1, *s!=' ');
+}
+
+
+// Subcommands: instead of decoding its arguments with cmd_isprefix() and cmd_parse_xxx(), a command may declare 
+// its subcommands, each with the types of its arguments, and a handler per subcommand. 
+// The declaration is a list macro with one X(name,args,choices,func) per subcommand, in alphabetical order:
+//   #define STAT_SUBS(X)  X( , "[h*", "", cmdstat_add )  X( reset, "", "", cmdstat_reset )  X( show, "", "", cmdstat_show )
+//   CMD_SUBS(stat_subs, STAT_SUBS)
+// The command handler then calls cmd_dispatch(argc, argv, stat_subs, CMD_TABLE_COUNT(stat_subs)).
+// It finds the subcommand argv[1] (may be abbreviated) with a binary search, parses the arguments following it 
+// into vals[] (one per argument), and calls func(argv,n,vals). Errors are printed in a uniform way.
+// The subcommand with the empty name (sorts first) is the default: it is used when argv[1] is no subcommand (or absent).
+// A one letter abbreviation is never ambiguous: it selects the first subcommand with that letter ("echo f" is faults).
+// When an abbreviated subcommand does not get matching arguments, the default gets the line ("echo w" prints "w").
+// Argument types (one char each): 'd' dec (vals[i].dec), 'h' hex (vals[i].hex16), 'H' hex32 (vals[i].hex32), 
+// 'e' one of the `choices` ("off|on", vals[i].index, may be abbreviated), 's' a word (vals[i].str), 
+// 'r' the rest of the line (vals[i].str, the words joined with single spaces, in place in the line; must be last).
+// A '[' marks the start of the optional arguments, a '*' after the last type repeats it (zero or more times).
+// Notes: a name is a C identifier (not a string), args and choices are string literals; the order is checked at compile time.
+typedef union cmd_val_u {
+  int      dec;   // Type 'd'
+  uint16_t hex16; // Type 'h'
+#if CMD_HEX32
+  uint32_t hex32; // Type 'H'
+#endif
+  int      index; // Type 'e': the index of the choice
+  char *   str;   // Type 's' and 'r'
+} cmd_val_t;
+// The handler of a subcommand: argv as passed to the command (argv[0] may start with '@'), and `n` parsed values
+typedef void (*cmd_subfunc_t)( char * argv[], int n, const cmd_val_t * vals );
+typedef struct cmd_sub_s {
+  const char *  name;    // The name of the subcommand ("" for the default)
+  const char *  args;    // The argument types
+  const char *  choices; // The choices for type 'e', separated by '|'
+  cmd_subfunc_t func;    // The handler
+} cmd_sub_t;
+// Dispatches the command in argv to one of the `count` PROGMEM `subs` (sorted on name). 
+// Returns false (after printing an error) when there is no matching subcommand or the arguments do not match.
+bool cmd_dispatch(int argc, char * argv[], /*PROGMEM*/const cmd_sub_t * subs, int count);
+// Implementation of the subcommand macros
+#define CMD_SUBS_STRS(name,args,choices,func) static const char func##_sname[] PROGMEM = #name; static const char func##_sargs[] PROGMEM = args; static const char func##_schoices[] PROGMEM = choices;
+#define CMD_SUBS_NAME(name,args,choices,func) #name,
+#define CMD_SUBS_DESC(name,args,choices,func) { func##_sname, func##_sargs, func##_schoices, func },
+#define CMD_SUBS_CHECK(name,args,choices,func) static_assert( cmd_subs_argsok(args), "CMD_SUBS: bad argument types: " args );
+#define CMD_SUBS(subs,list) \
+  list(CMD_SUBS_CHECK) \
+  list(CMD_SUBS_STRS) \
+  static constexpr const char * subs##_names[] = { list(CMD_SUBS_NAME) }; \
+  static_assert( cmd_table_sorted(subs##_names, CMD_TABLE_COUNT(subs##_names)), "CMD_SUBS " #subs ": subcommands must be in alphabetical order" ); \
+  static const cmd_sub_t subs[] PROGMEM = { list(CMD_SUBS_DESC) };
+// Compile-time helper for CMD_SUBS: checks the argument types `s` (optional part at most once, 'r' and '*' only at the end)
+constexpr bool cmd_subs_argsok(const char * s, bool optional=false) {
+  return *s=='\0' ? true
+       : *s=='[' ? !optional && cmd_subs_argsok(s+1,true)
+       : *s=='r' ? s[1]=='\0'
+       : *s=='d' || *s=='h' || (CMD_HEX32 && *s=='H') || *s=='e' || *s=='s' ? ( s[1]=='*' ? s[2]=='\0' : cmd_subs_argsok(s+1,optional) )
+       : false;
+}
 
 
 // Initializes the command interpreter.
@@ -76,9 +417,38 @@ void cmd_prompt();
 void cmd_add(int ch); // Suggested to use cmd_pollserial(), which reads chars from Serial and calls cmd_add()
 void cmd_addstr(const char * str); // Convenient for automatic testing of command line processing
 void cmd_addstr_P(/*PROGMEM*/const char * str); // Same as above, but str in PROGMEN
+void cmd_addbuf(const char * buf, size_t len); // Same as cmd_add() for all chars, but copies and echoes runs of ordinary chars in one go
 int  cmd_pendingschars(); // Returns the number of (not yet executed) chars.
 
 
+// A line may hold several commands separated by ';' (e.g. "echo line a; echo line b"); they execute one after the other.
+// When a command starts a task, the commands after it wait until the task ends.
+// In streaming mode a line is data: ';' is then a normal char. cmd_set_split(false) makes it so for commands too.
+// Batch mode is for hosts that send commands without waiting for the prompt (pipelining): there is no echo and no 
+// prompt, and each command (also each one on a ';' line) is followed by a status frame "#<seq> OK" or "#<seq> ERR <code>".
+// The sequence number counts the commands (blank ones excluded) from 0, when batch mode was switched on.
+// The frame of a command that starts a task follows when the task ends.
+#define CMD_OK            0 // The command succeeded
+#define CMD_ERR_NOTFOUND  1 // The command was not found
+#define CMD_ERR_AMBIGUOUS 2 // The command was ambiguous
+#define CMD_ERR_ARGS      3 // Wrong arguments (too many, or rejected by cmd_dispatch)
+#define CMD_ERR_SCRATCH   4 // Out of scratch memory
+#define CMD_ERR_CANCEL    5 // The task of the command was cancelled (Ctrl-C)
+#define CMD_ERR_FAIL      6 // The command failed (codes above this are free for the application)
+#if CMD_BATCH
+// Switches batch mode of the current instance on or off; switching on restarts the sequence numbers.
+void cmd_set_batch( bool on );
+// Returns true iff the current instance is in batch mode.
+bool cmd_get_batch( void );
+#endif
+// Switches splitting of command lines at ';' of the current instance on (default) or off (';' is then a normal char).
+void cmd_set_split( bool on );
+// Returns true iff the current instance splits command lines at ';'.
+bool cmd_get_split( void );
+// A command (or its task) reports failure with cmd_set_status(code); the status is CMD_OK otherwise.
+void cmd_set_status( int code );
+
+
 // The command handler can support streaming: sending data without commands. 
 // To enable streaming, a command must install a streaming function f with cmd_set_streamfunc(f).
 // Streaming is disabled via cmd_set_streamfunc(0).
@@ -88,10 +458,143 @@ cmd_func_t cmd_get_streamfunc(void);
 // Default prompt is >>, but when streaming is enabled a different prompt will be printed.
 // Note 'prompt' will be copied to internal cmd_buf[CMD_BUFSIZE].
 // Calling cmd_set_streamfunc(f) enables streaming; only when enabled the streamprompt is used.
+#if CMD_STREAMPROMPT
 void cmd_set_streamprompt(const char * prompt);
 void cmd_set_streampromptf(const char *format, ...);
 // Get the streaming prompt.
 const char * cmd_get_streamprompt(void);
+#endif
+
+
+// Instead of a streaming function, a command may install a raw streaming function f with cmd_set_streamrawfunc(f).
+// It receives each line as is: no comment stripping, no splitting in arguments, so no CMD_MAXARGS limit.
+// The line is 0-terminated (len equals strlen(line)) and lives in the interpreter's buffer; f may modify it in place.
+// Raw streaming takes precedence over streaming; it also uses the streaming prompt. Disable via cmd_set_streamrawfunc(0).
+typedef void (*cmd_rawfunc_t)( char * line, int len );
+void cmd_set_streamrawfunc(cmd_rawfunc_t func);
+// Check which raw streaming function is installed (0 for none).
+cmd_rawfunc_t cmd_get_streamrawfunc(void);
+
+
+#if CMD_BINARY
+// The command handler also supports binary streaming: sending raw bytes instead of text lines.
+// To enable binary streaming, a command must install a binary function f with cmd_set_binfunc(f).
+// In binary mode the input is a sequence of COBS encoded frames, each terminated by a 0x00 byte.
+// A decoded frame consists of a payload followed by its CRC (see cmd_crc16) with the low byte first.
+// For every correct frame f(payload,len) is called; the payload is at most CMD_BUFSIZE-2 bytes.
+// Frames that are too long or have a wrong CRC are dropped, and counted with cmd_steperrorcount().
+// A frame with an empty payload is the sentinel: it switches back to text mode (and prints the prompt).
+// There is no echo and no prompt in binary mode. When the line enabling it ends with "\r\n", the '\n' is skipped
+// (it is not taken as COBS code byte); a sender that ends that line with a single '\r' sends a 0x00 first.
+typedef void (*cmd_binfunc_t)( const uint8_t * data, int len );
+void cmd_set_binfunc(cmd_binfunc_t func);
+// Check which binary function is installed (0 for none).
+cmd_binfunc_t cmd_get_binfunc(void);
+// Returns the CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of `len` bytes at `data`.
+uint16_t cmd_crc16(const uint8_t * data, int len);
+#endif
+
+
+// Long running commands should not block (e.g. with delay()), since then input is lost. 
+// Instead, a command starts a task, a step function f, with cmd_start_task(f,state), and returns.
+// The poll functions (e.g. cmd_pollserial) call f(&state,false) until it returns false; each call should do a bounded amount of work.
+// While the task runs, input is buffered (no echo) and it executes after the task; the prompt is printed when the task ends.
+// The poll functions buffer only what fits in the line buffer; the rest waits in the stream or ring (see cmd_feedroom).
+// Receiving CMD_CANCEL (Ctrl-C) cancels the task: f(&state,true) is called once more, and buffered input is discarded.
+// There is one task per instance; `state` is for the task to keep its progress (e.g. a deadline, or a pointer).
+typedef bool (*cmd_taskfunc_t)( uint32_t * state, bool cancel );
+void cmd_start_task( cmd_taskfunc_t func, uint32_t state );
+// Returns true iff a task is running.
+bool cmd_task_active( void );
+
+
+// Output: all output of the interpreter (echo, prompt, errors, help, cmd_printf) goes to an output queue.
+// The queue is drained towards Serial without blocking (only what fits in the Serial transmit buffer), 
+// by cmd_pollserial() or cmd_outdrain(). Commands should print via cmd_out, e.g. cmd_out.print(F("done\n")).
+// Note that Serial must implement availableForWrite().
+class cmd_out_t : public Print {
+  public:
+    virtual size_t write(uint8_t ch);
+    virtual size_t write(const uint8_t * buf, size_t size);
+    using Print::write;
+};
+extern cmd_out_t cmd_out;
+// Writes queued output to Serial as far as possible without blocking. Returns the number of bytes still queued.
+int cmd_outdrain( void );
+// Writes all queued output to Serial (blocking). Call this before printing directly to Serial (outside commands).
+void cmd_outflush( void );
+// Counters on the output queue
+typedef struct cmd_outstats_s {
+  uint32_t bytes;  // Number of bytes written to cmd_out
+  uint32_t drops;  // Number of bytes dropped because the queue was full (only when CMD_OUTBLOCK is 0)
+  uint16_t stalls; // Number of times output had to wait for Serial (queue full, or flushed)
+} cmd_outstats_t;
+// Returns the output counters; when `clear` is true, the counters are cleared after being returned.
+cmd_outstats_t cmd_get_outstats( bool clear );
+
+
+#if CMD_FLOW
+// Flow control: instead of detecting overflows after the fact, the poll functions can stop the sender.
+// It is stopped (XOFF sent, or RTS pin set HIGH) when the bytes pending in the receive buffer reach the high-water mark, 
+// or before a line executes when the previous line was slow (see CMD_FLOW_SLOWUS). The poll function resumes the 
+// sender (XON sent, or RTS pin set LOW) when it has processed the input down to the low-water mark.
+// Note that with XON/XOFF a stopped sender also holds back Ctrl-C.
+#define CMD_FLOW_OFF     0
+#define CMD_FLOW_XONXOFF 1
+#define CMD_FLOW_RTS     2
+#define CMD_XON  0x11
+#define CMD_XOFF 0x13
+// Sets the flow control `mode` (one of CMD_FLOW_XXX) of the current instance; `pin` is the RTS pin (only for CMD_FLOW_RTS).
+void cmd_set_flow( int mode, int pin );
+// Returns the flow control mode of the current instance.
+int cmd_get_flow( void );
+// Sets the high-water and low-water mark (in bytes pending in the receive buffer) of the current instance.
+void cmd_set_flowmarks( int high, int low );
+// Counters on the input, e.g. to size the buffers
+typedef struct cmd_flowstats_s {
+  uint16_t rxpeak;  // Highest number of bytes found pending in the receive buffer (or receive ring)
+  uint16_t bufpeak; // Longest line (chars in buf, see CMD_BUFSIZE)
+  uint16_t stops;   // Number of times the sender was stopped
+} cmd_flowstats_t;
+// Returns the input counters; when `clear` is true, the counters are cleared after being returned.
+cmd_flowstats_t cmd_get_flowstats( bool clear );
+#endif
+
+
+#if CMD_STATS
+// Streaming statistics: a fixed size record (no buffer of values) that is updated per value, e.g. from a streaming function.
+// It keeps count, min and max, mean and variance (Welford's method, in fixed point with 8 fraction bits), 
+// a histogram of CMD_STATS_BINS bins, and estimates of the 50, 90 and 99 percentile (P-square sketches).
+// The histogram has bins of width 2^shift starting at lo; values below (above) it are counted in the first (last) bin.
+// A P-square sketch has 5 markers (min, max and 3 inner ones) that move towards the quantile and its neighbors.
+// Values should stay within +/-2^22 (so that the fixed point variance does not overflow).
+#define CMD_STATS_QUANTILES 3
+typedef struct cmd_stats_s {
+  uint32_t count;                        // Number of values
+  int32_t  min;                          // Smallest value
+  int32_t  max;                          // Largest value
+  int64_t  mean;                         // Mean, times 256
+  uint64_t m2;                           // Sum of squared differences from the mean, times 256
+  int32_t  lo;                           // Lower bound of the histogram
+  uint8_t  shift;                        // Bin width of the histogram is 2^shift
+  uint16_t bins[CMD_STATS_BINS];         // The histogram (the counts saturate)
+  int32_t  qh[3*CMD_STATS_QUANTILES];   // Per quantile (50, 90 and 99 percent) the heights of the inner markers
+  uint32_t qn[3*CMD_STATS_QUANTILES];   // and their positions
+} cmd_stats_t;
+// Clears `stats`, and sets its histogram to bins of width 2^shift starting at lo.
+void cmd_stats_init(cmd_stats_t * stats, int32_t lo, uint8_t shift);
+// Clears `stats` (keeps the histogram bounds).
+void cmd_stats_reset(cmd_stats_t * stats);
+// Adds `val` to `stats`; constant time.
+void cmd_stats_add(cmd_stats_t * stats, int32_t val);
+// Returns the variance of `stats` (times 256).
+uint64_t cmd_stats_variance(const cmd_stats_t * stats);
+// Returns the estimate of quantile `q` (0, 1, 2 for the 50, 90 and 99 percentile) of `stats`.
+int32_t cmd_stats_quantile(const cmd_stats_t * stats, int q);
+// Prints `stats` to cmd_out, prefixed with `name` (in PROGMEM, e.g. the command name); with `hist` also the histogram.
+// A command typically calls this from its show subcommand (see CMD_SUBS).
+void cmd_stats_print(const cmd_stats_t * stats, /*PROGMEM*/const char * name, bool hist);
+#endif
 
 
 // Helper functions
@@ -101,20 +604,233 @@ const char * cmd_get_streamprompt(void);
 bool cmd_parse_dec(const char*s,int*v);
 // Parse a string of a hex number ("0A8F"). Returns false if there were errors. If true is returned, *v is the parsed value.
 bool cmd_parse_hex(const char*s,uint16_t*v) ;
+#if CMD_HEX32
 // Parse a string of a hex number ("F1110A8F"), returns false if there were errors. If true is returned, *v is the parsed value.
 bool cmd_parse_hex32(const char*s,uint32_t*v);
+#endif
+// Parse argv[0..argc-1] into vals[0..argc-1] (e.g. cmd_parse_hex_array(argc-1,argv+1,vals) for all arguments of a command).
+// Returns the number of parsed tokens; when that is less than argc, it is the index of the first bad token.
+int cmd_parse_dec_array(int argc, char * argv[], int * vals);
+int cmd_parse_hex_array(int argc, char * argv[], uint16_t * vals);
+#if CMD_HEX32
+int cmd_parse_hex32_array(int argc, char * argv[], uint32_t * vals);
+#endif
 // Returns true iff `prefix` is a prefix of `str`. Note `str` must be in PROGMEM (`prefix` in RAM)
 bool cmd_isprefix(/*PROGMEM*/const char *str, const char *prefix);
 // Reads Serial and calls cmd_add()
 void cmd_pollserial( void );
-// A print towards Serial, just like Serial.print, but now with formatting as printf()
+// A print towards cmd_out, just like cmd_out.print, but now with formatting as printf()
 int cmd_printf(const char *format, ...);
-// A print towards Serial, just like Serial.print, but now with formatting as printf(), now from progmem
+#if CMD_PRINTF_P
+// A print towards cmd_out, just like cmd_out.print, but now with formatting as printf(), now from progmem
 int cmd_printf_P(/*PROGMEM*/const char *format, ...);
+#endif
+// The scratch arena (CMD_SCRATCH_SIZE bytes) for transient buffers; commands may use it too.
+// Allocation is last-in first-out: cmd_scratch_free(p) frees p and everything allocated after it.
+// Returns 0 when there is not enough space.
+void * cmd_scratch_alloc( int size );
+void   cmd_scratch_free( void * p );
+// Returns the number of free bytes in the scratch arena.
+int    cmd_scratch_avail( void );
+// Returns the highest number of scratch bytes in use (and optionally clears it), to size CMD_SCRATCH_SIZE.
+int    cmd_get_scratchpeak( bool clear );
 // When cmd_pollserial() detects Serial buffer overflows it steps an error counter
 void cmd_steperrorcount( void );
 // The current error counter can be obtained with this function; as a side effect it clears the counter.
 int  cmd_geterrorcount( void );
 
 
+// Instances: there can be multiple interpreters, each on its own Stream (e.g. Serial, Serial1, a WiFiClient).
+// They share the registered commands, but each has its own input buffer, echo flag, streaming mode, 
+// error counter and output queue. All functions above operate on the "current" instance. 
+// The default instance is on Serial; cmd_init() initializes it and makes it current, cmd_pollserial() polls it.
+// cmd_poll(cmd) makes `cmd` current while it processes input, so a command (and cmd_out) 
+// automatically works on the instance that received the command.
+// The buffer sizes of an instance are set by a configuration, declared with CMD_CONFIG; it also declares the buffers:
+//   CMD_CONFIG(cmd1_cfg, 40, 6, 4, 16) // bufsize, maxargs, promptsize, outsize (each at least 1)
+// A hand-made cmd_cfg_t may have no argv (it is then built in scratch) and no output queue (outbuf 0, outsize 0).
+typedef struct cmd_cfg_s {
+  char *         buf;                           // The input buffer
+  uint16_t       bufsize;                       // Its size: the longest line is bufsize-1 chars, see CMD_BUFSIZE
+  char **        argv;                          // The arguments of the line in buf (0: built in scratch, see CMD_ARGV_SCRATCH)
+  uint8_t        maxargs;                       // Their maximum number, see CMD_MAXARGS
+  char *         streamprompt;                  // The buffer for the streaming prompt
+  uint8_t        promptsize;                    // Its size, see CMD_PROMPT_SIZE
+  uint8_t *      outbuf;                        // The buffer for the output queue (0: none, output goes straight to the stream)
+  uint16_t       outsize;                       // Its size (0 when outbuf is 0), see CMD_OUTSIZE
+} cmd_cfg_t;
+#define CMD_CONFIG(cfg,bufsize,maxargs,promptsize,outsize) \
+  static char cfg##_buf[bufsize]; static char * cfg##_argv[maxargs]; static char cfg##_prompt[promptsize]; static uint8_t cfg##_outbuf[outsize]; \
+  static const cmd_cfg_t cfg= { cfg##_buf, bufsize, cfg##_argv, maxargs, cfg##_prompt, promptsize, cfg##_outbuf, outsize };
+typedef struct cmd_s {
+  Stream *       stream;                        // Input and output of this instance
+  int            rxsize;                        // Size of the receive buffer of stream (to detect overflows), 0 for none
+  char *         buf;                           // Incoming chars
+  uint16_t       bufsize;                       // Size of buf
+  uint8_t        maxargs;                       // Maximum number of arguments of a line
+  int            ix;                            // Fill pointer into buf
+  char **        argv;                          // Tokenizer: the start of each argument in buf (maxargs entries), or 0
+  int            argc;                          // Tokenizer: number of arguments (more than maxargs means too many)
+  int            cmt;                           // Tokenizer: index in buf of the comment ("//"), or -1
+  int            semi;                          // Tokenizer: index in buf of the first ';' (before the comment), or -1
+  int16_t        findlo[2];                     // Tokenizer: the commands (flash table, registered) that start with 
+  int16_t        findhi[2];                     //   the first argument are findlo[t]..findhi[t]-1 (see cmd_desc_name)
+  int16_t        findlen;                       // Tokenizer: the length of the first argument (without '@')
+  uint8_t        findgen;                       // Tokenizer: the registrations findlo/findhi are for
+  bool           echo;                          // Interpreter should echo incoming chars
+  cmd_func_t     streamfunc;                    // If 0, no streaming, else the streaming handler
+  cmd_rawfunc_t  streamrawfunc;                 // If 0, no raw streaming, else the raw streaming handler
+  char *         streamprompt;                  // If streaming, the streaming prompt
+  uint8_t        promptsize;                    // Size of streamprompt
+#if CMD_BINARY
+  cmd_binfunc_t  binfunc;                       // If 0, text mode, else binary mode with this frame handler
+  uint8_t        bin_rem;                       // Binary mode: number of data bytes left in current COBS block (0 means next is a code byte)
+  bool           bin_zero;                      // Binary mode: a zero must be inserted before the next COBS block
+  bool           bin_bad;                       // Binary mode: current frame did not fit in buf
+  bool           bin_lf;                        // Binary mode: the line enabling it ended with '\r' (a '\n' right after is skipped)
+#endif
+  int            errorcount;                    // See cmd_steperrorcount()
+  cmd_taskfunc_t taskfunc;                      // If 0, no task, else the task step function
+  uint32_t       taskstate;                     // The state of the task
+  uint8_t *      outbuf;                        // The output queue (a ring buffer)
+  uint16_t       outsize;                       // Size of outbuf
+  int            outhead;                       // Index of the oldest queued byte
+  int            outlen;                        // Number of queued bytes
+  bool           outaw;                         // Stream has reported space via availableForWrite()
+  cmd_outstats_t outstats;                      // See cmd_get_outstats()
+#if CMD_PROF
+  uint16_t       profechoed;                    // Number of bytes echoed for the line being entered
+#endif
+#if CMD_FLOW
+  uint8_t        flow;                          // Flow control mode (CMD_FLOW_XXX)
+  int8_t         flowpin;                       // The RTS pin (CMD_FLOW_RTS)
+  bool           flowstopped;                   // The sender is stopped
+  bool           flowslow;                      // The last line was slow
+  int            flowhigh;                      // High-water mark
+  int            flowlow;                       // Low-water mark
+  cmd_flowstats_t flowstats;                    // See cmd_get_flowstats()
+#endif
+#if CMD_BATCH
+  bool           batch;                         // Batch mode: no echo, no prompt, status frames
+  uint16_t       seq;                           // Sequence number of the next status frame
+#endif
+  bool           nosplit;                       // ';' does not separate commands (see cmd_set_split)
+  uint8_t        status;                        // Status of the executing command (CMD_OK or CMD_ERR_XXX)
+#if CMD_STATS
+  cmd_stats_t *  wakestats;                     // If not 0, records the latency from cmd_feed() to line execution
+  uint32_t       wakeus;                        // Time (micros) cmd_feed() was entered
+  bool           waking;                        // In cmd_feed()
+#endif
+  bool           captured;                      // Runs submitted lines (see cmd_subq_init): no echo, no prompt
+} cmd_t;
+// Initializes interpreter instance `cmd` on `stream` with the buffers of `cfg` (does not make it current). 
+// rxsize is the size of the receive buffer of the stream; reading that many bytes in one poll is flagged as overflow (0 disables).
+void cmd_init(cmd_t * cmd, Stream * stream, int rxsize, const cmd_cfg_t * cfg);
+// Same, but with buffers of the default sizes (CMD_BUFSIZE etc), allocated on the heap (once).
+void cmd_init(cmd_t * cmd, Stream * stream, int rxsize);
+// Polls the stream of instance `cmd` (like cmd_pollserial()), with `cmd` as current instance.
+void cmd_poll(cmd_t * cmd);
+// Makes `cmd` the current instance; returns the previous current instance.
+cmd_t * cmd_select(cmd_t * cmd);
+// Returns the current instance.
+cmd_t * cmd_current(void);
+
+
+// Receive ring: a single-producer/single-consumer lock-free ring, e.g. filled by a UART ISR, 
+// a DMA callback or another task (producer), and emptied by loop() (consumer), which executes the lines.
+// Overruns (bytes dropped because the ring was full) are counted exactly, instead of guessed by cmd_poll().
+#if CMD_RXSIZE<=128
+typedef uint8_t cmd_rxix_t;  // Free running indices, so that a full ring (count==CMD_RXSIZE) can be told apart
+#else
+typedef uint16_t cmd_rxix_t; // Note: not atomic on AVR (where the ring is typically filled from an ISR)
+#endif
+typedef struct cmd_rx_s {
+  uint8_t    buf[CMD_RXSIZE];
+  cmd_rxix_t head;          // Number of bytes put (written by producer only)
+  cmd_rxix_t tail;          // Number of bytes taken (written by consumer only)
+  uint16_t   overruns;      // Number of bytes dropped (written by producer only)
+  uint16_t   overruns_seen; // Number of dropped bytes already reported (consumer only)
+} cmd_rx_t;
+// Initializes receive ring `rx`.
+void cmd_rx_init( cmd_rx_t * rx );
+// Producer side: appends `ch` to `rx`. Returns false (and counts an overrun) when the ring is full. Safe to call from an ISR.
+bool cmd_rx_put( cmd_rx_t * rx, uint8_t ch );
+// Producer side: appends `len` bytes to `rx`. Returns the number of bytes appended (the others are overruns).
+int  cmd_rx_putbuf( cmd_rx_t * rx, const uint8_t * buf, int len );
+// Producer side: returns the number of bytes that can be put without overrun (a producer that can wait, checks this first).
+int  cmd_rx_room( cmd_rx_t * rx );
+// Consumer side: feeds all chars in `rx` to instance `cmd`, executing complete lines. Call this from loop().
+void cmd_rx_poll( cmd_t * cmd, cmd_rx_t * rx );
+// Returns the total number of bytes `rx` had to drop.
+uint16_t cmd_rx_overruns( cmd_rx_t * rx );
+
+
+// Event-driven input: instead of loop() polling a stream (cmd_poll) or a ring (cmd_rx_poll), a driver that 
+// sleeps until input is ready (an event loop, an RTOS task) pushes the received bytes with cmd_feed(); 
+// the stream of the instance is then only used for output. See extras/host/HostFd.h for a driver on epoll.
+// Feeds `len` received bytes to instance `cmd` (with `cmd` current); lines execute here. Also steps the task and 
+// drains the output queue, so cmd_feed(cmd,0,0) is the call for when the driver wakes up without input.
+void cmd_feed( cmd_t * cmd, const char * buf, int len );
+// Returns how many bytes cmd_feed() takes without losing any (while a task runs that may be 0: leave the input pending).
+int  cmd_feedroom( cmd_t * cmd );
+// Returns how long (ms) the driver of `cmd` may sleep without input: -1 for "until input arrives", 
+// or CMD_FEED_TICKMS when a task runs or output is queued (then it calls cmd_feed(cmd,0,0) after the sleep).
+int  cmd_waitms( cmd_t * cmd );
+#if CMD_STATS
+// Makes `cmd` record in `stats` the latency (us) from entering cmd_feed() (the wakeup) to the execution of each line.
+void cmd_set_wakestats( cmd_t * cmd, cmd_stats_t * stats );
+// Returns the latency statistics of the current instance (0 if not set).
+cmd_stats_t * cmd_get_wakestats( void );
+#endif
+
+
+#if CMD_SUBMIT
+// Submission queue: other tasks (e.g. a network task relaying remote commands) run lines on the interpreter task.
+// A task fills a cmd_submit_t (the line, a buffer for its output) and enqueues it with cmd_submit(); it does not touch 
+// any instance. The interpreter task calls cmd_subq_poll() from its loop: it executes the submitted lines one by one, 
+// in order, on an instance of its own, captures their output in the buffer, and then completes the submission.
+// The submitter polls cmd_submit_done() (or sleeps and retries); then it reads out, outlen and status.
+// The queue is lock-free: a producer takes a ticket (atomic compare-and-swap), each slot has a sequence number 
+// that tells whether it is free for that ticket, or filled. There is a single consumer (the interpreter task).
+typedef struct cmd_submit_s {
+  const char * line;    // The line to execute (without '\n'; ';' separates commands); must stay valid until done
+  char *       out;     // Buffer for the output, 0-terminated
+  int          outsize; // Its size; output beyond outsize-1 chars is dropped
+  int          outlen;  // Number of chars output (more than outsize-1 means truncated)
+  uint8_t      status;  // Status of the (last) command: CMD_OK or CMD_ERR_XXX
+  uint8_t      done;    // Set by the interpreter task when the line (and its task, if it started one) has finished
+} cmd_submit_t;
+// The stream of the instance of a submission queue: it appends the output to the running submission.
+class cmd_capture_t : public Stream {
+  public:
+    cmd_submit_t * sub; // The running submission, 0 for none (output is dropped)
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t write(uint8_t ch) { return write(&ch, 1); }
+    virtual size_t write(const uint8_t * buf, size_t size);
+    virtual int availableForWrite() { return 0x7FFF; }
+    using Print::write;
+};
+typedef struct cmd_subq_s {
+  cmd_submit_t * slots[CMD_SUBQ_SIZE]; // The queued submissions
+  uint32_t       seqs[CMD_SUBQ_SIZE];  // Slot i is free for ticket t when seqs[i]==t, and filled when seqs[i]==t+1
+  uint32_t       tail;                 // Next ticket for a producer
+  uint32_t       head;                 // Next ticket for the consumer (consumer only)
+  cmd_submit_t * cur;                  // The running submission (consumer only)
+  cmd_t *        cmd;                  // The instance that executes the lines
+  cmd_capture_t  capture;              // Its stream
+} cmd_subq_t;
+// Initializes submission queue `q` (empty), with `cmd` (with the buffers of `cfg`) as its instance.
+void cmd_subq_init( cmd_subq_t * q, cmd_t * cmd, const cmd_cfg_t * cfg );
+// Producer side (any task): enqueues `sub`. Returns false when the queue is full (then retry later).
+bool cmd_submit( cmd_subq_t * q, cmd_submit_t * sub );
+// Producer side: returns true iff `sub` has finished (its out, outlen and status are then valid).
+bool cmd_submit_done( const cmd_submit_t * sub );
+// Consumer side (the interpreter task): executes the submitted lines. Call this from loop(), next to the poll of the 
+// other instances. A line that starts a task completes when the task has ended; the next line waits until then.
+void cmd_subq_poll( cmd_subq_t * q );
+#endif
+
+
 #endif